@@ -0,0 +1,76 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _BENCH_CONTEXT_RECORD_H
+#define _BENCH_CONTEXT_RECORD_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "context-record.h"
+
+G_BEGIN_DECLS
+
+/* The calls of a context record file, as "(tsv)" GVariants, or NULL with
+ * a message on stderr if the file cannot be read. */
+static inline GPtrArray *
+bench_context_record_read(const char *path)
+{
+    GPtrArray *records;
+    gchar *contents;
+    gsize length, offset;
+
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        return NULL;
+    }
+
+    if (length < 4 || memcmp(contents, MALIIT_CONTEXT_RECORD_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a context record file\n", path);
+        g_free(contents);
+        return NULL;
+    }
+
+    records = g_ptr_array_new_with_free_func((GDestroyNotify) g_variant_unref);
+    for (offset = 4; offset + sizeof(guint32) <= length; ) {
+        guint32 size;
+        GBytes *bytes;
+        GVariant *record;
+
+        memcpy(&size, contents + offset, sizeof(size));
+        offset += sizeof(size);
+        if (size > length - offset) {
+            fprintf(stderr, "%s is truncated\n", path);
+            break;
+        }
+
+        /* Copied, so that the data is aligned for GVariant. */
+        bytes = g_bytes_new(contents + offset, size);
+        record = g_variant_new_from_bytes(G_VARIANT_TYPE(MALIIT_CONTEXT_RECORD_TYPE), bytes, FALSE);
+        g_ptr_array_add(records, g_variant_ref_sink(record));
+        g_bytes_unref(bytes);
+        offset += size;
+    }
+
+    g_free(contents);
+    return records;
+}
+
+G_END_DECLS
+
+#endif // _BENCH_CONTEXT_RECORD_H
@@ -0,0 +1,197 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* What a context costs an application with thousands of text widgets, of
+ * which only one is ever focused at a time: the time to create and
+ * destroy one, and the heap it holds while never focused. The state kept
+ * for the server is only allocated on first focus, so this should be the
+ * instance alone.
+ *
+ * Each context is then focused once against mock-server, as a widget
+ * would be when the user tabs through all of them, and the heap measured
+ * again: right away, while every context still holds its state, and once
+ * the states have been released into the pool, when it should be back to
+ * what it was before. */
+
+#include <stdlib.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "bench-server.h"
+#include "bench-util.h"
+#include "client-imcontext-gtk.h"
+
+#define DEFAULT_CONTEXTS 10000
+/* Contexts keep their state for 30 s after losing the focus. */
+#define RELEASE_TIMEOUT_SECONDS 60
+
+static GtkIMContext **contexts;
+static gint n_contexts;
+static GMainLoop *loop = NULL;
+
+/* -1 where the C library cannot tell. */
+static gint64
+heap_bytes(void)
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#endif
+#endif
+    return -1;
+}
+
+
+static gint
+contexts_with_state(void)
+{
+    gint with_state = 0;
+    gint i;
+
+    for (i = 0; i < n_contexts; i++)
+        with_state += MALIIT_IM_CONTEXT(contexts[i])->state != NULL;
+
+    return with_state;
+}
+
+
+static gboolean
+check_released(gpointer user_data G_GNUC_UNUSED)
+{
+    if (contexts_with_state() > 0)
+        return G_SOURCE_CONTINUE;
+
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+timeout(gpointer user_data G_GNUC_UNUSED)
+{
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+
+/* -1.0 where the C library cannot tell. */
+static double
+heap_per_context(gint64 heap_start)
+{
+    return heap_start < 0 ? -1.0 : (double) (heap_bytes() - heap_start) / n_contexts;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const gchar *args[] = { NULL };
+    GtkWidget *toplevel;
+    GdkWindow *window = NULL;
+    gchar *address = NULL;
+    GPid server_pid;
+    gint64 heap_start, start;
+    double heap_unfocused, heap_focused, heap_released;
+    gint with_state, with_state_focused, with_state_released;
+    gint i;
+
+    n_contexts = argc > 1 ? atoi(argv[1]) : DEFAULT_CONTEXTS;
+    if (n_contexts <= 0) {
+        fprintf(stderr, "usage: %s [contexts]\n", argv[0]);
+        return 1;
+    }
+
+    server_pid = bench_server_start(args, &address);
+    if (!server_pid)
+        return 1;
+
+    if (!bench_server_connect(address)) {
+        bench_server_stop(server_pid);
+        return 1;
+    }
+
+    if (gtk_init_check(&argc, &argv)) {
+        toplevel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_widget_realize(toplevel);
+        window = gtk_widget_get_window(toplevel);
+    }
+
+    maliit_im_context_register_type(NULL);
+    contexts = g_new(GtkIMContext *, n_contexts);
+
+    /* The first instance initializes the class, which is not measured. */
+    g_object_unref(maliit_im_context_new());
+
+    heap_start = heap_bytes();
+    start = bench_now_ns();
+    for (i = 0; i < n_contexts; i++)
+        contexts[i] = maliit_im_context_new();
+    bench_report("context_new", bench_now_ns() - start, n_contexts);
+    heap_unfocused = heap_per_context(heap_start);
+    with_state = contexts_with_state();
+
+    /* Connected before the loop, so that the calls go out as they are
+     * made rather than wait in the queue with their widget states. */
+    gtk_im_context_set_client_window(contexts[0], window);
+    gtk_im_context_focus_in(contexts[0]);
+    if (!bench_server_wait_ready()) {
+        bench_server_stop(server_pid);
+        return 1;
+    }
+    gtk_im_context_focus_out(contexts[0]);
+
+    start = bench_now_ns();
+    for (i = 1; i < n_contexts; i++) {
+        gtk_im_context_set_client_window(contexts[i], window);
+        gtk_im_context_focus_in(contexts[i]);
+        gtk_im_context_focus_out(contexts[i]);
+
+        /* Replies the server sent meanwhile. */
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+    }
+    if (n_contexts > 1)
+        bench_report("context_focus", bench_now_ns() - start, n_contexts - 1);
+    heap_focused = heap_per_context(heap_start);
+    with_state_focused = contexts_with_state();
+
+    loop = g_main_loop_new(NULL, FALSE);
+    g_timeout_add_seconds(1, check_released, NULL);
+    g_timeout_add_seconds(RELEASE_TIMEOUT_SECONDS, timeout, NULL);
+    g_main_loop_run(loop);
+    heap_released = heap_per_context(heap_start);
+    with_state_released = contexts_with_state();
+
+    start = bench_now_ns();
+    for (i = n_contexts - 1; i >= 0; i--)
+        g_object_unref(contexts[i]);
+    bench_report("context_unref", bench_now_ns() - start, n_contexts);
+
+    printf("{\"benchmark\": \"contexts\", \"contexts\": %d, \"instance_bytes\": %" G_GSIZE_FORMAT ", "
+           "\"heap_bytes_per_context\": %.1f, \"with_state\": %d, "
+           "\"heap_bytes_per_focused_context\": %.1f, \"with_state_focused\": %d, "
+           "\"heap_bytes_per_released_context\": %.1f, \"with_state_released\": %d}\n",
+           n_contexts, sizeof(MaliitIMContext), heap_unfocused, with_state,
+           heap_focused, with_state_focused, heap_released, with_state_released);
+
+    bench_server_stop(server_pid);
+    g_free(contexts);
+    return 0;
+}
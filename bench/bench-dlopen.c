@@ -0,0 +1,108 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* What loading the immodule costs a GTK process: the time dlopen() takes
+ * to map and relocate the module and everything it pulls in, and how much
+ * resident memory and how many shared objects that adds. GTK is linked in
+ * already, as it would be in a real application, so only the module's own
+ * dependencies are measured. Run it against builds of two revisions to
+ * compare them. */
+
+#define _GNU_SOURCE /* dl_iterate_phdr() */
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+
+static int
+count_object(struct dl_phdr_info *info, size_t size, void *data)
+{
+    (void) info;
+    (void) size;
+    (*(int *) data)++;
+    return 0;
+}
+
+static int
+loaded_objects(void)
+{
+    int count = 0;
+
+    dl_iterate_phdr(count_object, &count);
+    return count;
+}
+
+static glong
+resident_kb(void)
+{
+    gchar *status = NULL;
+    const gchar *line;
+    glong kb = -1;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL))
+        return -1;
+
+    line = strstr(status, "VmRSS:");
+    if (line)
+        kb = strtol(line + strlen("VmRSS:"), NULL, 10);
+
+    g_free(status);
+    return kb;
+}
+
+int
+main(int argc, char **argv)
+{
+    glong rss_before, rss_after;
+    int objects_before, objects_after;
+    gint64 start, elapsed;
+    void *module;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s /path/to/im-maliit.so\n", argv[0]);
+        return 1;
+    }
+
+    /* Make sure GTK's own dependencies are mapped before measuring. */
+    (void) gtk_im_context_simple_get_type();
+
+    rss_before = resident_kb();
+    objects_before = loaded_objects();
+
+    start = bench_now_ns();
+    module = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+    elapsed = bench_now_ns() - start;
+
+    if (!module) {
+        fprintf(stderr, "dlopen failed: %s\n", dlerror());
+        return 1;
+    }
+
+    rss_after = resident_kb();
+    objects_after = loaded_objects();
+
+    printf("{\"benchmark\": \"dlopen\", \"ns\": %" G_GINT64_FORMAT ", "
+           "\"resident_kb\": %ld, \"shared_objects\": %d}\n",
+           elapsed, rss_after - rss_before, objects_after - objects_before);
+
+    dlclose(module);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Per-key cost of the keysym <-> Qt key translation done on every
+ * keystroke. Each range of keysyms is timed on its own, since they take
+ * different paths: Latin-1 maps to itself, the legacy ranges below 0x3000
+ * are tagged as Unicode, and the function keys and vendor keysyms go
+ * through the table, which is hit and missed in turn. Every Qt key found
+ * is mapped back. */
+
+#include "bench-util.h"
+#include "qt-keysym-map.h"
+
+#define ROUNDS 200
+
+#define QT_KEY_UNKNOWN 0x01ffffff
+
+static const guint vendor_keysyms[] = {
+    0x1005FF60, /* Sun SysReq */
+    0x1007ff00, /* X386 SysReq */
+    0x1000FF74, /* HP backtab */
+    0x1005FF10, /* Sun F36 */
+    0x1005FF11, /* Sun F37 */
+};
+
+static void
+bench_keysyms(const char *range, const guint *keysyms, guint n_keysyms)
+{
+    GArray *qt_keys = g_array_new(FALSE, FALSE, sizeof(int));
+    gchar *name;
+    guint i;
+    int round;
+    gint64 start;
+
+    for (i = 0; i < n_keysyms; i++) {
+        int qt_key = XKeySymToQTKey(keysyms[i]);
+        if (qt_key != QT_KEY_UNKNOWN)
+            g_array_append_val(qt_keys, qt_key);
+    }
+
+    name = g_strdup_printf("XKeySymToQTKey/%s", range);
+    start = bench_now_ns();
+    for (round = 0; round < ROUNDS; round++)
+        for (i = 0; i < n_keysyms; i++)
+            bench_sink += XKeySymToQTKey(keysyms[i]);
+    bench_report(name, bench_now_ns() - start, (gint64) ROUNDS * n_keysyms);
+    g_free(name);
+
+    if (qt_keys->len) {
+        name = g_strdup_printf("QtKeyToXKeySym/%s", range);
+        start = bench_now_ns();
+        for (round = 0; round < ROUNDS; round++)
+            for (i = 0; i < qt_keys->len; i++)
+                bench_sink += QtKeyToXKeySym(g_array_index(qt_keys, int, i));
+        bench_report(name, bench_now_ns() - start, (gint64) ROUNDS * qt_keys->len);
+        g_free(name);
+    }
+
+    g_array_free(qt_keys, TRUE);
+}
+
+static void
+bench_range(const char *range, guint first, guint last)
+{
+    GArray *keysyms = g_array_new(FALSE, FALSE, sizeof(guint));
+    guint keysym;
+
+    for (keysym = first; keysym <= last; keysym++)
+        g_array_append_val(keysyms, keysym);
+
+    bench_keysyms(range, (const guint *) keysyms->data, keysyms->len);
+    g_array_free(keysyms, TRUE);
+}
+
+int
+main(void)
+{
+    bench_range("latin1", 0x0020, 0x00ff);
+    bench_range("legacy", 0x0100, 0x2fff);
+    bench_range("function", 0xfe00, 0xffff);
+    bench_range("all", 0x0020, 0xffff);
+    bench_keysyms("vendor", vendor_keysyms, G_N_ELEMENTS(vendor_keysyms));
+
+    return 0;
+}
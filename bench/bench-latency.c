@@ -0,0 +1,290 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Keystroke-to-commit latency through the whole input path: key events
+ * are filtered by a MaliitIMContext, go to a server over D-Bus, and the
+ * time until the widget gets the commit is measured for each.
+ *
+ * The server is mock-server, started for the run unless --server gives
+ * the address of one already running; --delay and --mode are handed to
+ * it. Keys go out one at a time by default, each once the previous one is
+ * committed. --outstanding keeps more of them in flight, for throughput
+ * under load, and --rate types at a fixed pace instead.
+ *
+ * No display is needed. When there is one (Xvfb or Broadway will do), the
+ * context gets a real client window. Only keys that type text are sent,
+ * so a commit comes back for each press in every mode of the server. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+#include "bench-server.h"
+#include "client-imcontext-gtk.h"
+
+/* Gives up on keys that have not come back by then. */
+#define RUN_TIMEOUT_SECONDS 60
+
+typedef struct {
+    GtkIMContext *context;
+    GdkWindow *window;
+    gint keys;
+    gint outstanding;
+    gint rate;
+
+    gint sent;
+    gint committed;
+    GArray *sent_at;   /* gint64 monotonic time in ns of each press */
+    GArray *latencies; /* gint64 ns */
+    gint64 started;
+    guint send_id;
+    GMainLoop *loop;
+} Run;
+
+
+static void
+send_key(Run *run, guint keyval, GdkEventType type)
+{
+    GdkEventKey event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.window = run->window;
+    event.time = bench_now_ns() / 1000000;
+    event.keyval = keyval;
+    event.hardware_keycode = keyval;
+
+    gtk_im_context_filter_keypress(run->context, &event);
+}
+
+
+static void
+send_keystroke(Run *run)
+{
+    guint keyval = 'a' + run->sent % 26;
+    gint64 now = bench_now_ns();
+
+    g_array_append_val(run->sent_at, now);
+    run->sent++;
+
+    send_key(run, keyval, GDK_KEY_PRESS);
+    send_key(run, keyval, GDK_KEY_RELEASE);
+}
+
+
+/* Closed loop: as many keys as may be outstanding, topped up from an idle
+ * after each commit rather than from within the commit signal. */
+static gboolean
+send_outstanding(gpointer user_data)
+{
+    Run *run = user_data;
+
+    run->send_id = 0;
+    while (run->sent < run->keys && run->sent - run->committed < run->outstanding)
+        send_keystroke(run);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+/* Open loop: the keys due by now at the requested rate, whatever came
+ * back already. */
+static gboolean
+send_at_rate(gpointer user_data)
+{
+    Run *run = user_data;
+    gint64 due = (bench_now_ns() - run->started) * run->rate / G_GINT64_CONSTANT(1000000000) + 1;
+
+    while (run->sent < run->keys && run->sent < due)
+        send_keystroke(run);
+
+    if (run->sent < run->keys)
+        return G_SOURCE_CONTINUE;
+
+    run->send_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+
+static void
+committed(GtkIMContext *context G_GNUC_UNUSED, const gchar *text G_GNUC_UNUSED, Run *run)
+{
+    gint64 latency;
+
+    if (run->committed >= run->sent)
+        return;
+
+    latency = bench_now_ns() - g_array_index(run->sent_at, gint64, run->committed);
+    g_array_append_val(run->latencies, latency);
+    run->committed++;
+
+    if (run->committed == run->keys)
+        g_main_loop_quit(run->loop);
+    else if (!run->rate && !run->send_id)
+        run->send_id = g_idle_add(send_outstanding, run);
+}
+
+
+static gboolean
+run_timeout(gpointer user_data)
+{
+    Run *run = user_data;
+
+    fprintf(stderr, "%d of %d keys not committed after %d s\n",
+            run->keys - run->committed, run->keys, RUN_TIMEOUT_SECONDS);
+    g_main_loop_quit(run->loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+static gint
+compare_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static double
+percentile_us(GArray *sorted, double percent)
+{
+    guint index = (guint) (percent / 100.0 * (sorted->len - 1) + 0.5);
+
+    return g_array_index(sorted, gint64, index) / 1000.0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    gchar *server_address = NULL;
+    gchar *delay = NULL;
+    gchar *mode = NULL;
+    Run run = { NULL, NULL, 1000, 1, 0 };
+    GOptionEntry entries[] = {
+        { "server", 's', 0, G_OPTION_ARG_STRING, &server_address,
+          "Address of a running server, instead of starting mock-server", "ADDRESS" },
+        { "delay", 'd', 0, G_OPTION_ARG_STRING, &delay,
+          "Milliseconds mock-server waits before answering a key", "MS" },
+        { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+          "How mock-server answers keys: commit, preedit or key", "MODE" },
+        { "keys", 'k', 0, G_OPTION_ARG_INT, &run.keys, "Keys to type", "N" },
+        { "outstanding", 'o', 0, G_OPTION_ARG_INT, &run.outstanding,
+          "Keys typed ahead of the last commit", "N" },
+        { "rate", 'r', 0, G_OPTION_ARG_INT, &run.rate,
+          "Type N keys per second regardless of commits", "N" },
+        { NULL }
+    };
+    GOptionContext *options = g_option_context_new("- keystroke to commit latency");
+    GDBusConnection *connection;
+    GtkWidget *toplevel = NULL;
+    GError *error = NULL;
+    GPid server_pid = 0;
+    gchar *name;
+    double elapsed_s;
+    int status = 1;
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    if (run.keys <= 0 || run.outstanding <= 0 || run.rate < 0) {
+        fprintf(stderr, "--keys and --outstanding must be positive, --rate not negative\n");
+        return 1;
+    }
+
+    if (!delay)
+        delay = g_strdup("0");
+    if (!mode)
+        mode = g_strdup("commit");
+
+    if (!server_address) {
+        const gchar *args[] = { "--delay", delay, "--mode", mode, NULL };
+
+        server_pid = bench_server_start(args, &server_address);
+        if (!server_pid)
+            return 1;
+    }
+
+    connection = bench_server_connect(server_address);
+    if (!connection)
+        goto out;
+
+    if (gtk_init_check(&argc, &argv)) {
+        toplevel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_widget_show(toplevel);
+        run.window = gtk_widget_get_window(toplevel);
+    }
+
+    maliit_im_context_register_type(NULL);
+    run.context = maliit_im_context_new();
+    gtk_im_context_set_client_window(run.context, run.window);
+    gtk_im_context_focus_in(run.context);
+
+    if (!bench_server_wait_ready())
+        goto out;
+
+    run.sent_at = g_array_sized_new(FALSE, FALSE, sizeof(gint64), run.keys);
+    run.latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), run.keys);
+    run.loop = g_main_loop_new(NULL, FALSE);
+    g_signal_connect(run.context, "commit", G_CALLBACK(committed), &run);
+
+    run.started = bench_now_ns();
+    if (run.rate)
+        run.send_id = g_timeout_add(MAX(1, 1000 / run.rate), send_at_rate, &run);
+    else
+        run.send_id = g_idle_add(send_outstanding, &run);
+    g_timeout_add_seconds(RUN_TIMEOUT_SECONDS, run_timeout, &run);
+
+    g_main_loop_run(run.loop);
+    elapsed_s = (bench_now_ns() - run.started) / 1e9;
+
+    if (run.latencies->len == 0) {
+        fprintf(stderr, "No key was committed\n");
+        goto out;
+    }
+
+    g_array_sort(run.latencies, compare_gint64);
+
+    if (run.rate)
+        name = g_strdup_printf("latency/%s/delay=%s/rate=%d", mode, delay, run.rate);
+    else
+        name = g_strdup_printf("latency/%s/delay=%s/outstanding=%d", mode, delay, run.outstanding);
+
+    printf("{\"benchmark\": \"%s\", \"keys\": %d, \"committed\": %u, "
+           "\"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, "
+           "\"keys_per_s\": %.1f}\n",
+           name, run.keys, run.latencies->len,
+           percentile_us(run.latencies, 50), percentile_us(run.latencies, 90),
+           percentile_us(run.latencies, 99), percentile_us(run.latencies, 100),
+           run.latencies->len / elapsed_s);
+    g_free(name);
+
+    status = run.committed == run.keys ? 0 : 1;
+
+out:
+    if (server_pid)
+        bench_server_stop(server_pid);
+
+    return status;
+}
@@ -0,0 +1,133 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Cost of turning the format list of an updatePreedit call into Pango
+ * attributes, for CJK preedits of up to several hundred characters split
+ * into up to dozens of segments. The per-segment conversion it replaced
+ * is measured alongside for comparison. */
+
+#include "bench-util.h"
+#include "preedit-attrs.h"
+
+#define ROUNDS 200
+
+static const gint preedit_lengths[] = { 16, 128, 512 };
+static const gint segment_counts[] = { 1, 8, 48 };
+
+
+/* One validation and two walks from the start of the string per segment,
+ * and new attributes for each, as before the offset index. */
+static PangoAttrList *
+build_per_segment(const gchar *string, GVariant *format_list)
+{
+    PangoAttrList *attrs = pango_attr_list_new();
+    gsize i;
+
+    for (i = 0; i < g_variant_n_children(format_list); i++) {
+        gint start, length, face;
+        gint byte_start = 0, byte_end = 0;
+        PangoAttribute *new_attrs[2];
+        gint j;
+
+        g_variant_get_child(format_list, i, "(iii)", &start, &length, &face);
+
+        if (g_utf8_validate(string, -1, NULL)) {
+            byte_start = g_utf8_offset_to_pointer(string, start) - string;
+            byte_end = g_utf8_offset_to_pointer(string, start + length) - string;
+        }
+
+        new_attrs[0] = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+        new_attrs[1] = pango_attr_underline_color_new(0, 0, 0);
+
+        for (j = 0; j < 2; j++) {
+            new_attrs[j]->start_index = byte_start;
+            new_attrs[j]->end_index = byte_end;
+            pango_attr_list_insert(attrs, new_attrs[j]);
+        }
+    }
+
+    return attrs;
+}
+
+
+static gchar *
+make_preedit(gint n_chars)
+{
+    GString *string = g_string_new(NULL);
+    gint i;
+
+    /* CJK ideographs, three bytes each in UTF-8 */
+    for (i = 0; i < n_chars; i++)
+        g_string_append_unichar(string, 0x4e00 + i % 0x5000);
+
+    return g_string_free(string, FALSE);
+}
+
+
+/* Segments of equal length covering the preedit, cycling through the faces. */
+static GVariant *
+make_format_list(gint n_chars, gint n_segments)
+{
+    GVariantBuilder builder;
+    gint segment_length = MAX(n_chars / n_segments, 1);
+    gint i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(iii)"));
+    for (i = 0; i < n_segments; i++)
+        g_variant_builder_add(&builder, "(iii)",
+                              MIN(i * segment_length, n_chars), segment_length,
+                              i % (MaliitPreeditActive + 1));
+
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+
+int
+main(void)
+{
+    guint l, s;
+
+    for (l = 0; l < G_N_ELEMENTS(preedit_lengths); l++) {
+        for (s = 0; s < G_N_ELEMENTS(segment_counts); s++) {
+            gchar *preedit = make_preedit(preedit_lengths[l]);
+            GVariant *format_list = make_format_list(preedit_lengths[l], segment_counts[s]);
+            gchar *name;
+            gint64 start;
+            int round;
+
+            start = bench_now_ns();
+            for (round = 0; round < ROUNDS; round++)
+                pango_attr_list_unref(maliit_preedit_attrs_build(preedit, format_list));
+            name = g_strdup_printf("preedit_attrs/%d chars/%d segments",
+                                   preedit_lengths[l], segment_counts[s]);
+            bench_report(name, bench_now_ns() - start, ROUNDS);
+            g_free(name);
+
+            start = bench_now_ns();
+            for (round = 0; round < ROUNDS; round++)
+                pango_attr_list_unref(build_per_segment(preedit, format_list));
+            name = g_strdup_printf("per_segment/%d chars/%d segments",
+                                   preedit_lengths[l], segment_counts[s]);
+            bench_report(name, bench_now_ns() - start, ROUNDS);
+            g_free(name);
+
+            g_variant_unref(format_list);
+            g_free(preedit);
+        }
+    }
+
+    return 0;
+}
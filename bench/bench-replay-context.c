@@ -0,0 +1,276 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Replays the calls of a context record, made with MALIIT_CONTEXT_RECORD
+ * against a real server, at a MaliitIMContext, and reports how the module
+ * copes with the storm:
+ *
+ *   main_loop_busy     share of the time the main loop was not waiting
+ *                      in poll(), and the busy time per call
+ *   preedit_changed    emissions, each of which costs the widget a
+ *                      relayout, against the updatePreedit calls made
+ *   rss/heap growth    memory left allocated after the replay
+ *
+ * mock-server makes the calls, all at once or with --realtime at the
+ * recorded pace, --repeat times over. keyEvent calls for keys that do not
+ * type text put GDK events, which needs a display (Xvfb or Broadway will
+ * do); everything else runs headless. */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+#include "bench-server.h"
+#include "bench-context-record.h"
+#include "client-connection.h"
+#include "client-imcontext-gtk.h"
+
+/* Gives up on calls that have not come in by then. */
+#define RUN_TIMEOUT_SECONDS 60
+
+static gint calls_received = 0;
+static GPollFunc default_poll = NULL;
+static gint64 poll_ns = 0;
+
+
+/* Called from the D-Bus worker thread for every message, both ways. */
+static GDBusMessage *
+count_call(GDBusConnection *connection G_GNUC_UNUSED,
+           GDBusMessage *message,
+           gboolean incoming,
+           gpointer user_data G_GNUC_UNUSED)
+{
+    if (incoming && g_dbus_message_get_message_type(message) == G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+        g_atomic_int_inc(&calls_received);
+
+    return message;
+}
+
+
+/* Time spent waiting is time the main loop was not busy. */
+static gint
+timed_poll(GPollFD *fds, guint nfds, gint timeout)
+{
+    gint64 start = bench_now_ns();
+    gint result = default_poll(fds, nfds, timeout);
+
+    poll_ns += bench_now_ns() - start;
+    return result;
+}
+
+
+static gboolean
+count_emission(GSignalInvocationHint *hint G_GNUC_UNUSED,
+               guint n_params G_GNUC_UNUSED,
+               const GValue *params G_GNUC_UNUSED,
+               gpointer user_data)
+{
+    (*(guint *) user_data)++;
+    return TRUE;
+}
+
+
+static gboolean
+set_flag(gpointer user_data)
+{
+    *(gboolean *) user_data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+
+static glong
+resident_kb(void)
+{
+    gchar *status = NULL;
+    const gchar *line;
+    glong kb = -1;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL))
+        return -1;
+
+    line = strstr(status, "VmRSS:");
+    if (line)
+        kb = strtol(line + strlen("VmRSS:"), NULL, 10);
+
+    g_free(status);
+    return kb;
+}
+
+
+static glong
+heap_kb(void)
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks / 1024;
+#endif
+#endif
+    return -1;
+}
+
+
+static guint
+count_method(GPtrArray *records, const gchar *name)
+{
+    guint count = 0, i;
+
+    for (i = 0; i < records->len; i++) {
+        const gchar *method;
+
+        g_variant_get(g_ptr_array_index(records, i), "(t&sv)", NULL, &method, NULL);
+        count += strcmp(method, name) == 0;
+    }
+
+    return count;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    gboolean realtime = FALSE;
+    gint repeat = 1;
+    GOptionEntry entries[] = {
+        { "realtime", 't', 0, G_OPTION_ARG_NONE, &realtime,
+          "Replay at the recorded pace", NULL },
+        { "repeat", 'n', 0, G_OPTION_ARG_INT, &repeat,
+          "Replay the record this many times", "N" },
+        { NULL }
+    };
+    GOptionContext *options = g_option_context_new("RECORD - replay recorded server calls");
+    GPtrArray *records;
+    GDBusConnection *connection;
+    GtkIMContext *context;
+    GtkWidget *toplevel;
+    GError *error = NULL;
+    GPid server_pid;
+    gchar *server_address = NULL;
+    gchar *repeat_arg, *name;
+    guint preedit_changed = 0, commits = 0;
+    gboolean timed_out = FALSE;
+    guint total, update_preedits;
+    gint calls_start;
+    gint64 wall_start, wall_ns;
+    glong rss_start, heap_start;
+    int status = 1;
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    if (argc != 2 || repeat < 1) {
+        fprintf(stderr, "usage: %s [--realtime] [--repeat N] RECORD\n", argv[0]);
+        return 1;
+    }
+
+    records = bench_context_record_read(argv[1]);
+    if (!records || records->len == 0)
+        return 1;
+    total = records->len * repeat;
+    update_preedits = count_method(records, "updatePreedit") * repeat;
+
+    repeat_arg = g_strdup_printf("%d", repeat);
+    {
+        const gchar *args[] = { "--replay", argv[1], "--repeat", repeat_arg,
+                                realtime ? "--realtime" : NULL, NULL };
+
+        server_pid = bench_server_start(args, &server_address);
+        if (!server_pid)
+            return 1;
+    }
+
+    connection = bench_server_connect(server_address);
+    if (!connection)
+        goto out;
+    g_dbus_connection_add_filter(connection, count_call, NULL, NULL);
+
+    if (gtk_init_check(&argc, &argv)) {
+        toplevel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_widget_show(toplevel);
+    } else {
+        toplevel = NULL;
+    }
+
+    maliit_im_context_register_type(NULL);
+    context = maliit_im_context_new();
+    gtk_im_context_set_client_window(context, toplevel ? gtk_widget_get_window(toplevel) : NULL);
+    gtk_im_context_focus_in(context);
+
+    if (!bench_server_wait_ready())
+        goto out;
+
+    g_signal_add_emission_hook(g_signal_lookup("preedit-changed", GTK_TYPE_IM_CONTEXT), 0,
+                               count_emission, &preedit_changed, NULL);
+    g_signal_add_emission_hook(g_signal_lookup("commit", GTK_TYPE_IM_CONTEXT), 0,
+                               count_emission, &commits, NULL);
+
+    default_poll = g_main_context_get_poll_func(NULL);
+    g_main_context_set_poll_func(NULL, timed_poll);
+
+    rss_start = resident_kb();
+    heap_start = heap_kb();
+    calls_start = g_atomic_int_get(&calls_received);
+    wall_start = bench_now_ns();
+
+    kill(server_pid, SIGUSR1);
+    g_timeout_add_seconds(RUN_TIMEOUT_SECONDS, set_flag, &timed_out);
+
+    while ((guint) (g_atomic_int_get(&calls_received) - calls_start) < total && !timed_out)
+        g_main_context_iteration(NULL, TRUE);
+
+    if (timed_out) {
+        fprintf(stderr, "%u of %u calls not received after %d s\n",
+                total - (g_atomic_int_get(&calls_received) - calls_start), total,
+                RUN_TIMEOUT_SECONDS);
+        goto out;
+    }
+
+    /* The last calls are in, but may still wait for dispatch: a round trip
+     * to the server gets them all queued, then they and what they
+     * scheduled are handled. */
+    maliit_server_call_reset_sync(maliit_connection_get_server(), NULL, NULL);
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+
+    wall_ns = bench_now_ns() - wall_start;
+
+    name = g_path_get_basename(argv[1]);
+    printf("{\"benchmark\": \"replay-context/%s\", \"calls\": %u, \"wall_s\": %.3f, "
+           "\"main_loop_busy\": %.3f, \"busy_us_per_call\": %.2f, "
+           "\"update_preedit\": %u, \"preedit_changed\": %u, \"commits\": %u, "
+           "\"rss_growth_kb\": %ld, \"heap_growth_kb\": %ld}\n",
+           name, total, wall_ns / 1e9,
+           1.0 - (double) poll_ns / wall_ns, (wall_ns - poll_ns) / 1e3 / total,
+           update_preedits, preedit_changed, commits,
+           resident_kb() - rss_start, heap_start < 0 ? -1 : heap_kb() - heap_start);
+    g_free(name);
+
+    status = 0;
+
+out:
+    bench_server_stop(server_pid);
+    return status;
+}
@@ -0,0 +1,347 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Replays key events recorded with MALIIT_KEY_RECORD into a
+ * MaliitIMContext connected to mock-server, and reports what each
+ * keystroke cost the process: CPU time, heap allocations, and D-Bus
+ * messages sent and received. A keystroke is a key press; its release and
+ * whatever the server sends back are counted with it.
+ *
+ * Keys go in as fast as the main loop takes them, or with --realtime at
+ * the pace they were typed, with pauses cut to --max-pause. No display is
+ * needed; when there is one the context gets a real client window.
+ *
+ * Allocations are counted by wrapping malloc() and friends, with glibc
+ * only. Depending on the GLib version, GSlice may serve some of them from
+ * its own caches without malloc() seeing them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+#include "bench-server.h"
+#include "client-connection.h"
+#include "client-imcontext-gtk.h"
+#include "key-record.h"
+
+typedef struct {
+    GtkIMContext *context;
+    GdkWindow *window;
+    GArray *records;
+    guint next;
+    gboolean realtime;
+    guint max_pause;
+    GMainLoop *loop;
+} Replay;
+
+static gint dbus_sent = 0;
+static gint dbus_received = 0;
+
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint allocations = 0;
+
+void *
+malloc(size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_realloc(ptr, size);
+}
+
+#define ALLOCATIONS() g_atomic_int_get(&allocations)
+#else
+#define ALLOCATIONS() 0
+#endif /* __GLIBC__ */
+
+
+static GArray *
+read_records(const char *path)
+{
+    MaliitKeyRecordHeader header;
+    MaliitKeyRecord record;
+    GArray *records;
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, MALIIT_KEY_RECORD_MAGIC, sizeof(header.magic)) != 0 ||
+        header.record_size != sizeof(MaliitKeyRecord)) {
+        fprintf(stderr, "%s is not a key record file\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    records = g_array_new(FALSE, FALSE, sizeof(MaliitKeyRecord));
+    while (fread(&record, sizeof(record), 1, file) == 1)
+        g_array_append_val(records, record);
+
+    fclose(file);
+    return records;
+}
+
+
+/* Called from the D-Bus worker thread for every message, both ways. */
+static GDBusMessage *
+count_message(GDBusConnection *connection G_GNUC_UNUSED,
+              GDBusMessage *message,
+              gboolean incoming,
+              gpointer user_data G_GNUC_UNUSED)
+{
+    g_atomic_int_inc(incoming ? &dbus_received : &dbus_sent);
+    return message;
+}
+
+
+static void
+replay_record(Replay *replay, const MaliitKeyRecord *record)
+{
+    GdkEventKey event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = record->release ? GDK_KEY_RELEASE : GDK_KEY_PRESS;
+    event.window = replay->window;
+    event.time = record->time;
+    event.keyval = record->keyval;
+    event.state = record->state;
+    event.hardware_keycode = record->hardware_keycode;
+    event.group = record->group;
+
+    gtk_im_context_filter_keypress(replay->context, &event);
+}
+
+
+/* One event per main loop iteration, so that the replies of the server
+ * are handled in between as they would be. */
+static gboolean
+replay_next(gpointer user_data)
+{
+    Replay *replay = user_data;
+    const MaliitKeyRecord *record;
+    guint pause;
+
+    if (replay->next >= replay->records->len) {
+        g_main_loop_quit(replay->loop);
+        return G_SOURCE_REMOVE;
+    }
+
+    record = &g_array_index(replay->records, MaliitKeyRecord, replay->next++);
+    replay_record(replay, record);
+
+    if (!replay->realtime || replay->next >= replay->records->len)
+        return G_SOURCE_CONTINUE;
+
+    pause = MIN(g_array_index(replay->records, MaliitKeyRecord, replay->next).time - record->time,
+                replay->max_pause);
+    g_timeout_add(pause, replay_next, replay);
+    return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+set_flag(gpointer user_data)
+{
+    *(gboolean *) user_data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+
+/* Wait until the server is done with what was sent: after waiting out
+ * its delay, a round trip to it that sees no other message go by. Returns
+ * the messages of the round trips, which are not part of the replay. */
+static gint
+settle(guint delay_ms)
+{
+    MaliitServer *server = maliit_connection_get_server();
+    gint own_messages = 0;
+    gint before;
+
+    do {
+        gboolean waited = FALSE;
+
+        g_timeout_add(delay_ms, set_flag, &waited);
+        while (!waited)
+            g_main_context_iteration(NULL, TRUE);
+
+        before = g_atomic_int_get(&dbus_sent) + g_atomic_int_get(&dbus_received);
+        maliit_server_call_reset_sync(server, NULL, NULL);
+        own_messages += 2;
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+    } while (g_atomic_int_get(&dbus_sent) + g_atomic_int_get(&dbus_received) != before + 2);
+
+    return own_messages;
+}
+
+
+static gint64
+cpu_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    gchar *server_address = NULL;
+    gchar *delay = NULL;
+    gchar *mode = NULL;
+    gint max_pause = 1000;
+    Replay replay = { NULL, NULL, NULL, 0, FALSE, 0, NULL };
+    GOptionEntry entries[] = {
+        { "server", 's', 0, G_OPTION_ARG_STRING, &server_address,
+          "Address of a running server, instead of starting mock-server", "ADDRESS" },
+        { "delay", 'd', 0, G_OPTION_ARG_STRING, &delay,
+          "Milliseconds mock-server waits before answering a key", "MS" },
+        { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+          "How mock-server answers keys: commit, preedit or key", "MODE" },
+        { "realtime", 'r', 0, G_OPTION_ARG_NONE, &replay.realtime,
+          "Replay at the pace the keys were typed", NULL },
+        { "max-pause", 'p', 0, G_OPTION_ARG_INT, &max_pause,
+          "Longest pause between keys with --realtime, in ms", "MS" },
+        { NULL }
+    };
+    GOptionContext *options = g_option_context_new("RECORD - replay recorded key events");
+    GDBusConnection *connection;
+    GtkWidget *toplevel = NULL;
+    GError *error = NULL;
+    GPid server_pid = 0;
+    gint64 wall_start, cpu_start, wall_ns, cpu_ns;
+    gint allocations_start, allocations_made;
+    gint sent_start, received_start, own_messages;
+    guint keystrokes = 0, i;
+    gchar *name;
+    int status = 1;
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s [OPTION...] RECORD\n", argv[0]);
+        return 1;
+    }
+
+    replay.records = read_records(argv[1]);
+    if (!replay.records)
+        return 1;
+    replay.max_pause = MAX(max_pause, 0);
+
+    for (i = 0; i < replay.records->len; i++)
+        keystrokes += !g_array_index(replay.records, MaliitKeyRecord, i).release;
+    if (!keystrokes) {
+        fprintf(stderr, "%s holds no key press\n", argv[1]);
+        return 1;
+    }
+
+    if (!delay)
+        delay = g_strdup("0");
+    if (!mode)
+        mode = g_strdup("commit");
+
+    if (!server_address) {
+        const gchar *args[] = { "--delay", delay, "--mode", mode, NULL };
+
+        server_pid = bench_server_start(args, &server_address);
+        if (!server_pid)
+            return 1;
+    }
+
+    connection = bench_server_connect(server_address);
+    if (!connection)
+        goto out;
+    g_dbus_connection_add_filter(connection, count_message, NULL, NULL);
+
+    if (gtk_init_check(&argc, &argv)) {
+        toplevel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_widget_show(toplevel);
+        replay.window = gtk_widget_get_window(toplevel);
+    }
+
+    maliit_im_context_register_type(NULL);
+    replay.context = maliit_im_context_new();
+    gtk_im_context_set_client_window(replay.context, replay.window);
+    gtk_im_context_focus_in(replay.context);
+
+    if (!bench_server_wait_ready())
+        goto out;
+
+    replay.loop = g_main_loop_new(NULL, FALSE);
+
+    wall_start = bench_now_ns();
+    cpu_start = cpu_time_ns();
+    allocations_start = ALLOCATIONS();
+    sent_start = g_atomic_int_get(&dbus_sent);
+    received_start = g_atomic_int_get(&dbus_received);
+
+    g_idle_add(replay_next, &replay);
+    g_main_loop_run(replay.loop);
+    own_messages = settle(atoi(delay));
+
+    wall_ns = bench_now_ns() - wall_start;
+    cpu_ns = cpu_time_ns() - cpu_start;
+    allocations_made = ALLOCATIONS() - allocations_start;
+
+    name = g_path_get_basename(argv[1]);
+    printf("{\"benchmark\": \"replay/%s\", \"events\": %u, \"keystrokes\": %u, "
+           "\"wall_s\": %.3f, \"cpu_us_per_key\": %.2f, \"allocations_per_key\": %.1f, "
+           "\"dbus_sent_per_key\": %.2f, \"dbus_received_per_key\": %.2f}\n",
+           name, replay.records->len, keystrokes, wall_ns / 1e9,
+           cpu_ns / 1e3 / keystrokes, (double) allocations_made / keystrokes,
+           (double) (g_atomic_int_get(&dbus_sent) - sent_start - own_messages / 2) / keystrokes,
+           (double) (g_atomic_int_get(&dbus_received) - received_start - own_messages / 2) / keystrokes);
+    g_free(name);
+
+    status = 0;
+
+out:
+    if (server_pid)
+        bench_server_stop(server_pid);
+
+    return status;
+}
@@ -0,0 +1,137 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+#include <maliit-glib/maliitbus.h>
+
+#include "bench-server.h"
+#include "client-connection.h"
+
+#define READY_TIMEOUT_SECONDS 10
+
+GPid
+bench_server_start(const gchar * const *args, gchar **address)
+{
+    GPtrArray *argv = g_ptr_array_new();
+    GError *error = NULL;
+    gint out_fd;
+    GPid pid;
+    FILE *out;
+    gchar line[1024];
+
+    g_ptr_array_add(argv, MOCK_SERVER);
+    for (; *args; args++)
+        g_ptr_array_add(argv, (gpointer) *args);
+    g_ptr_array_add(argv, NULL);
+
+    if (!g_spawn_async_with_pipes(NULL, (gchar **) argv->pdata, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+                                  NULL, NULL, &pid, NULL, &out_fd, NULL, &error)) {
+        fprintf(stderr, "Unable to start %s: %s\n", MOCK_SERVER, error->message);
+        g_clear_error(&error);
+        g_ptr_array_free(argv, TRUE);
+        return 0;
+    }
+    g_ptr_array_free(argv, TRUE);
+
+    out = fdopen(out_fd, "r");
+    if (!out || !fgets(line, sizeof(line), out)) {
+        fprintf(stderr, "%s did not print its address\n", MOCK_SERVER);
+        bench_server_stop(pid);
+        return 0;
+    }
+
+    *address = g_strdup(g_strchomp(line));
+    return pid;
+}
+
+
+void
+bench_server_stop(GPid pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    g_spawn_close_pid(pid);
+}
+
+
+GDBusConnection *
+bench_server_connect(const gchar *address)
+{
+    GDBusConnection *connection;
+    GError *error = NULL;
+
+    connection = g_dbus_connection_new_for_address_sync(address,
+                                                        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                        NULL, NULL, &error);
+    if (!connection) {
+        fprintf(stderr, "Unable to connect to %s: %s\n", address, error->message);
+        g_clear_error(&error);
+        return NULL;
+    }
+
+    maliit_set_bus(connection);
+    return connection;
+}
+
+
+static gboolean
+set_flag(gpointer user_data)
+{
+    *(gboolean *) user_data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+
+/* Until the server turns on key redirection, which it does when the
+ * context is activated, keys are handled locally. The server answers
+ * calls in order, so once it answered one more call after the activation,
+ * the redirection request is in, and it is handled with the rest of what
+ * is pending. */
+gboolean
+bench_server_wait_ready(void)
+{
+    MaliitServer *server;
+    GError *error = NULL;
+    gboolean timed_out = FALSE;
+    guint timeout_id;
+
+    /* Wakes the loop up even if nothing else happens. */
+    timeout_id = g_timeout_add_seconds(READY_TIMEOUT_SECONDS, set_flag, &timed_out);
+    while (!maliit_connection_is_ready() && !timed_out)
+        g_main_context_iteration(NULL, TRUE);
+    if (!timed_out)
+        g_source_remove(timeout_id);
+
+    server = maliit_connection_get_server();
+    if (!maliit_connection_is_ready() || !server) {
+        fprintf(stderr, "Unable to connect to the server within %d s\n", READY_TIMEOUT_SECONDS);
+        return FALSE;
+    }
+
+    if (!maliit_server_call_reset_sync(server, NULL, &error)) {
+        fprintf(stderr, "The server does not answer: %s\n", error->message);
+        g_clear_error(&error);
+        return FALSE;
+    }
+
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+
+    return TRUE;
+}
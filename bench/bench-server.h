@@ -0,0 +1,39 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _BENCH_SERVER_H
+#define _BENCH_SERVER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Start mock-server with the given NULL-terminated arguments, and return
+ * its pid and the address it listens on; 0 if it did not start. */
+GPid bench_server_start(const gchar * const *args, gchar **address);
+void bench_server_stop(GPid pid);
+
+/* Connect to the server at the address and have maliit-glib use that
+ * connection instead of looking for maliit-server. */
+GDBusConnection *bench_server_connect(const gchar *address);
+
+/* Wait until a focused MaliitIMContext is connected and the server has
+ * turned on key redirection. */
+gboolean bench_server_wait_ready(void);
+
+G_END_DECLS
+
+#endif // _BENCH_SERVER_H
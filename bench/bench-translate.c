@@ -0,0 +1,172 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Cost of the key event translation on either side of the D-Bus call:
+ * gdk_key_event_to_qt() for every key filtered, and on the way back
+ * qt_key_event_is_text_input() plus qt_key_event_to_gdk() for every key
+ * event the server sends. The events mix letters, digits, editing and
+ * function keys, with and without modifiers.
+ *
+ * Without a display the GdkEventKey is built for no window, which leaves
+ * out the keycode lookup; when a display can be opened it is timed again
+ * against a real window. */
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+#include "qt-gtk-translate.h"
+#include "qt-keysym-map.h"
+
+#define ROUNDS 20000
+
+/* From Qt's qcoreevent.h and qnamespace.h, see qt-constants.h. */
+#define QT_KEY_PRESS 6
+#define QT_KEY_RELEASE 7
+#define QT_SHIFT_MODIFIER 0x02000000
+#define QT_CONTROL_MODIFIER 0x04000000
+
+static const guint keyvals[] = {
+    GDK_KEY_a, GDK_KEY_Z, GDK_KEY_5, GDK_KEY_space, GDK_KEY_comma,
+    GDK_KEY_eacute, GDK_KEY_Cyrillic_ka, GDK_KEY_Return, GDK_KEY_BackSpace,
+    GDK_KEY_Tab, GDK_KEY_Left, GDK_KEY_Home, GDK_KEY_Delete, GDK_KEY_F5,
+    GDK_KEY_Shift_L, GDK_KEY_Escape,
+};
+
+static const guint states[] = {
+    0, GDK_SHIFT_MASK, GDK_CONTROL_MASK, GDK_SHIFT_MASK | GDK_MOD1_MASK,
+};
+
+static const char *texts[] = {
+    "a", "Z", "5", " ", ",", "\xc3\xa9", "\xd0\xba", "\r", "\b",
+    "\t", NULL, NULL, NULL, NULL, NULL, "\x1b",
+};
+
+static void
+bench_gdk_to_qt(void)
+{
+    GdkEventKey events[G_N_ELEMENTS(keyvals) * G_N_ELEMENTS(states) * 2];
+    guint n_events = 0;
+    guint i, j;
+    int round;
+    int type, key, modifiers;
+    gint64 start;
+
+    memset(events, 0, sizeof(events));
+    for (i = 0; i < G_N_ELEMENTS(keyvals); i++) {
+        for (j = 0; j < G_N_ELEMENTS(states); j++) {
+            GdkEventKey *event = &events[n_events++];
+            event->type = GDK_KEY_PRESS;
+            event->keyval = keyvals[i];
+            event->state = states[j];
+
+            events[n_events] = *event;
+            events[n_events++].type = GDK_KEY_RELEASE;
+        }
+    }
+
+    start = bench_now_ns();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < n_events; i++) {
+            if (gdk_key_event_to_qt(&events[i], &type, &key, &modifiers))
+                bench_sink += key + modifiers;
+        }
+    }
+    bench_report("gdk_key_event_to_qt", bench_now_ns() - start, (gint64) ROUNDS * n_events);
+}
+
+static void
+bench_qt_to_gdk(const char *name, GdkWindow *window, int rounds)
+{
+    int keys[G_N_ELEMENTS(keyvals)];
+    guint i, j;
+    int round;
+    gint64 start;
+
+    for (i = 0; i < G_N_ELEMENTS(keyvals); i++)
+        keys[i] = XKeySymToQTKey(keyvals[i]);
+
+    start = bench_now_ns();
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < G_N_ELEMENTS(keys); i++) {
+            for (j = 0; j < 2; j++) {
+                GdkEventKey *event;
+
+                event = qt_key_event_to_gdk(j ? QT_KEY_RELEASE : QT_KEY_PRESS, keys[i],
+                                            QT_SHIFT_MODIFIER, texts[i], window);
+                bench_sink += event->hardware_keycode;
+                gdk_event_free((GdkEvent *) event);
+            }
+        }
+    }
+    bench_report(name, bench_now_ns() - start, (gint64) rounds * G_N_ELEMENTS(keys) * 2);
+}
+
+static void
+bench_text_input(void)
+{
+    static const int modifiers[] = { 0, QT_SHIFT_MODIFIER, QT_CONTROL_MODIFIER };
+    guint i, j;
+    int round;
+    gboolean is_press;
+    gint64 start;
+
+    start = bench_now_ns();
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < G_N_ELEMENTS(texts); i++) {
+            for (j = 0; j < G_N_ELEMENTS(modifiers); j++)
+                bench_sink += qt_key_event_is_text_input(QT_KEY_PRESS, modifiers[j],
+                                                         texts[i], &is_press);
+        }
+    }
+    bench_report("qt_key_event_is_text_input", bench_now_ns() - start,
+                 (gint64) ROUNDS * G_N_ELEMENTS(texts) * G_N_ELEMENTS(modifiers));
+}
+
+static GdkWindow *
+create_window(void)
+{
+    GdkWindowAttr attributes;
+
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.window_type = GDK_WINDOW_TOPLEVEL;
+    attributes.wclass = GDK_INPUT_OUTPUT;
+    attributes.width = 1;
+    attributes.height = 1;
+
+    return gdk_window_new(NULL, &attributes, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    gboolean have_display = gtk_init_check(&argc, &argv);
+
+    bench_gdk_to_qt();
+    bench_text_input();
+    bench_qt_to_gdk("qt_key_event_to_gdk", NULL, ROUNDS);
+
+    if (have_display) {
+        GdkWindow *window = create_window();
+
+        /* The first event fills the display's keycode cache. */
+        bench_qt_to_gdk("qt_key_event_to_gdk/window", window, ROUNDS / 10);
+        gdk_window_destroy(window);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _BENCH_UTIL_H
+#define _BENCH_UTIL_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Keeps the compiler from dropping the results of the measured calls. */
+static volatile gint64 bench_sink;
+
+static inline gint64
+bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/* Results are written one JSON object per line, so that the output of
+ * the whole suite can be collected and compared between revisions by a
+ * script. Names must not need escaping. */
+static inline void
+bench_report(const char *name, gint64 elapsed_ns, gint64 operations)
+{
+    printf("{\"benchmark\": \"%s\", \"ns_per_op\": %.2f, \"ops\": %" G_GINT64_FORMAT "}\n",
+           name, (double) elapsed_ns / operations, operations);
+    fflush(stdout);
+}
+
+G_END_DECLS
+
+#endif // _BENCH_UTIL_H
@@ -0,0 +1,117 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Cost of rebuilding the widget state that is sent to the server on focus
+ * and after every edit, for surrounding texts from a short entry up to a
+ * large document. The text is fetched through retrieve-surrounding as a
+ * widget would provide it, with the cursor in the middle. "unchanged"
+ * calls again without touching the text, which the surrounding text cache
+ * answers; "moved" moves the cursor by one character between calls, so
+ * the window around it is cut and hashed again each time. */
+
+#include <gtk/gtk.h>
+
+#include "bench-util.h"
+#include "client-imcontext-gtk.h"
+
+typedef struct {
+    GString *text;
+    gint cursor[2];
+    guint turn;
+    gboolean move;
+} Surrounding;
+
+static gboolean
+retrieve_surrounding(GtkIMContext *context, Surrounding *surrounding)
+{
+    gint cursor = surrounding->cursor[surrounding->move ? surrounding->turn++ & 1 : 0];
+
+    gtk_im_context_set_surrounding(context, surrounding->text->str,
+                                   surrounding->text->len, cursor);
+    return TRUE;
+}
+
+static void
+fill_text(GString *text, gsize size)
+{
+    static const char pattern[] = "Lorem ipsum dolor sit am\xc3\xa9t, \xe6\x96\x87\xe5\xad\x97 ";
+
+    g_string_truncate(text, 0);
+    while (text->len < size)
+        g_string_append(text, pattern);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const gsize sizes[] = { 16, 256, 4096, 65536, 1048576 };
+    Surrounding surrounding = { NULL, { 0, 0 }, 0, FALSE };
+    MaliitIMContext *im_context;
+    GtkIMContext *context;
+    guint i, move;
+
+    /* Not needed for anything measured here, but lets GTK set itself up as
+     * it would in an application when a display is around. */
+    gtk_init_check(&argc, &argv);
+
+    maliit_im_context_register_type(NULL);
+    context = maliit_im_context_new();
+    im_context = MALIIT_IM_CONTEXT(context);
+    im_context->focus_state = TRUE;
+
+    surrounding.text = g_string_new(NULL);
+    g_signal_connect(context, "retrieve-surrounding",
+                     G_CALLBACK(retrieve_surrounding), &surrounding);
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        glong middle;
+        int rounds = CLAMP(G_GINT64_CONSTANT(64) * 1024 * 1024 / sizes[i], 100, 100000);
+
+        fill_text(surrounding.text, sizes[i]);
+        middle = g_utf8_strlen(surrounding.text->str, -1) / 2;
+        surrounding.cursor[0] = g_utf8_offset_to_pointer(surrounding.text->str, middle) -
+                                surrounding.text->str;
+        surrounding.cursor[1] = g_utf8_next_char(surrounding.text->str + surrounding.cursor[0]) -
+                                surrounding.text->str;
+
+        for (move = 0; move < 2; move++) {
+            gchar *name;
+            gint64 start;
+            int round;
+
+            surrounding.move = move;
+            maliit_im_context_update_widget_info(im_context);
+            maliit_surrounding_text_cache_invalidate(&im_context->state->surrounding_text_cache);
+            maliit_im_context_update_widget_info(im_context);
+
+            start = bench_now_ns();
+            for (round = 0; round < rounds; round++) {
+                maliit_im_context_update_widget_info(im_context);
+                bench_sink += g_variant_n_children(im_context->state->widget_state);
+            }
+
+            name = g_strdup_printf("update_widget_info/%" G_GSIZE_FORMAT "/%s",
+                                   sizes[i], move ? "moved" : "unchanged");
+            bench_report(name, bench_now_ns() - start, rounds);
+            g_free(name);
+        }
+    }
+
+    g_object_unref(context);
+    g_string_free(surrounding.text, TRUE);
+
+    return 0;
+}
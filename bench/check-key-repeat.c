@@ -0,0 +1,151 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Holding a key types one character per auto-repeated press, even though
+ * the presses queued behind each other are folded into one
+ * processKeyEvent with a count. A press and --keys - 1 repeats are
+ * filtered in one go, so that all the repeats get folded, and the
+ * characters committed through mock-server (in --mode commit or key) are
+ * counted. Exits with 0 if there are as many as presses. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "bench-server.h"
+#include "client-imcontext-gtk.h"
+#include "metrics.h"
+
+#define TIMEOUT_SECONDS 10
+
+static gint committed = 0;
+static GMainLoop *loop = NULL;
+
+
+static void
+commit(GtkIMContext *context G_GNUC_UNUSED, const gchar *text, gpointer user_data)
+{
+    committed += g_utf8_strlen(text, -1);
+    if (committed >= GPOINTER_TO_INT(user_data))
+        g_main_loop_quit(loop);
+}
+
+
+static gboolean
+timeout(gpointer user_data G_GNUC_UNUSED)
+{
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+
+static void
+send_key(GtkIMContext *context, GdkWindow *window, GdkEventType type)
+{
+    GdkEventKey event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.window = window;
+    event.keyval = 'a';
+    event.hardware_keycode = 38;
+
+    gtk_im_context_filter_keypress(context, &event);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    static gchar *mode = NULL;
+    static gint keys = 50;
+    static const GOptionEntry entries[] = {
+        { "mode", 0, 0, G_OPTION_ARG_STRING, &mode, "How the server sends keys back (commit or key)", "MODE" },
+        { "keys", 0, 0, G_OPTION_ARG_INT, &keys, "Presses, all but the first auto-repeated", "N" },
+        { NULL }
+    };
+    GOptionContext *options = g_option_context_new("- auto-repeated keys through the server");
+    const gchar *args[] = { "--mode", NULL, NULL };
+    GtkWidget *toplevel = NULL;
+    GdkWindow *window = NULL;
+    GtkIMContext *context;
+    GError *error = NULL;
+    gchar *address = NULL;
+    GPid server_pid;
+    guint64 folded;
+    gint i;
+    int status = 1;
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    if (keys < 2) {
+        fprintf(stderr, "--keys must be at least 2\n");
+        return 1;
+    }
+
+    args[1] = mode ? mode : "commit";
+    server_pid = bench_server_start(args, &address);
+    if (!server_pid)
+        return 1;
+
+    if (!bench_server_connect(address))
+        goto out;
+
+    if (gtk_init_check(&argc, &argv)) {
+        toplevel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+        gtk_widget_show(toplevel);
+        window = gtk_widget_get_window(toplevel);
+    }
+
+    maliit_im_context_register_type(NULL);
+    context = maliit_im_context_new();
+    gtk_im_context_set_client_window(context, window);
+    gtk_im_context_focus_in(context);
+
+    if (!bench_server_wait_ready())
+        goto out;
+
+    loop = g_main_loop_new(NULL, FALSE);
+    g_signal_connect(context, "commit", G_CALLBACK(commit), GINT_TO_POINTER(keys));
+
+    folded = maliit_counters[MALIIT_COUNTER_KEY_EVENTS_FOLDED];
+    for (i = 0; i < keys; i++)
+        send_key(context, window, GDK_KEY_PRESS);
+    send_key(context, window, GDK_KEY_RELEASE);
+    folded = maliit_counters[MALIIT_COUNTER_KEY_EVENTS_FOLDED] - folded;
+
+    g_timeout_add_seconds(TIMEOUT_SECONDS, timeout, NULL);
+    g_main_loop_run(loop);
+
+    printf("%s: %d presses, %" G_GUINT64_FORMAT " folded, %d characters committed\n",
+           args[1], keys, folded, committed);
+
+    if (folded == 0)
+        fprintf(stderr, "No press was folded, nothing was checked\n");
+    else if (committed == keys)
+        status = 0;
+
+out:
+    bench_server_stop(server_pid);
+    return status;
+}
@@ -0,0 +1,471 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* A stand-in for maliit-server, for measuring the module without one.
+ *
+ * It listens on a private peer-to-peer D-Bus address, printed on the
+ * first line of its output, and serves the server interface to whoever
+ * connects. Every call is answered right away, except processKeyEvent:
+ * typed keys come back to the client after --delay milliseconds, as the
+ * server of a simple keyboard would send them, and the call is answered
+ * after that, as the server answers once it has handled the key:
+ *
+ *   commit   commitString with the key's text (the default)
+ *   preedit  updatePreedit with the text, then commitString
+ *   key      keyEvent with the key itself, press and release
+ *
+ * Keys without text always come back as keyEvent. Auto-repeated presses
+ * the client folded into one call, with a count, come back as that many
+ * characters, or as one keyEvent with the same count. Key redirection is
+ * turned on for every client when it activates its context.
+ *
+ * With --replay, the calls of a context record file are made on the
+ * context of the latest client on SIGUSR1: all at once, or with
+ * --realtime at their recorded pace, --repeat times over. */
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <maliit-glib/maliitserver.h>
+#include <maliit-glib/maliitcontext.h>
+
+#include "bench-context-record.h"
+
+#define SERVER_OBJECT_PATH "/com/meego/inputmethod/uiserver1"
+#define CONTEXT_OBJECT_PATH "/com/meego/inputmethod/inputcontext"
+
+/* From Qt's qcoreevent.h and qnamespace.h, see qt-constants.h. */
+#define QT_KEY_PRESS 6
+#define QT_FIRST_SPECIAL_KEY 0x01000000
+
+typedef enum {
+    REPLY_COMMIT,
+    REPLY_PREEDIT,
+    REPLY_KEY
+} ReplyMode;
+
+typedef struct {
+    GDBusConnection *connection;
+    MaliitServer *server;
+    MaliitContext *context;
+} Client;
+
+typedef struct {
+    MaliitServer *server;
+    GDBusMethodInvocation *invocation;
+    MaliitContext *context;
+    gint64 due;
+    gint type;
+    gint key;
+    gint modifiers;
+    gint count;
+    gchar *text;
+} Reply;
+
+static ReplyMode reply_mode = REPLY_COMMIT;
+static gint reply_delay_ms = 0;
+static GQueue replies = G_QUEUE_INIT;
+static guint replies_timeout_id = 0;
+
+static Client *replay_client = NULL;
+static GPtrArray *replay_records = NULL;
+static gboolean replay_realtime = FALSE;
+static gint replay_repeat = 1;
+static guint replay_next = 0; /* index into the records repeated replay_repeat times */
+
+
+static void
+reply_free(Reply *reply)
+{
+    g_object_unref(reply->server);
+    g_object_unref(reply->context);
+    g_free(reply->text);
+    g_slice_free(Reply, reply);
+}
+
+
+static void
+send_reply(const Reply *reply)
+{
+    gboolean has_text = reply->text[0] != '\0';
+    GString *text;
+    gint i;
+
+    if (reply_mode == REPLY_KEY || !has_text) {
+        maliit_context_call_key_event(reply->context, reply->type, reply->key, reply->modifiers,
+                                      reply->text, reply->count > 1, reply->count, 0,
+                                      NULL, NULL, NULL);
+        return;
+    }
+
+    if (reply->type != QT_KEY_PRESS)
+        return;
+
+    text = g_string_new(NULL);
+    for (i = 0; i < reply->count; i++)
+        g_string_append(text, reply->text);
+
+    if (reply_mode == REPLY_PREEDIT) {
+        GVariantBuilder format;
+
+        g_variant_builder_init(&format, G_VARIANT_TYPE("a(iii)"));
+        g_variant_builder_add(&format, "(iii)", 0, (gint) g_utf8_strlen(text->str, -1), 1);
+        maliit_context_call_update_preedit(reply->context, text->str,
+                                           g_variant_builder_end(&format),
+                                           0, 0, -1, NULL, NULL, NULL);
+    }
+
+    maliit_context_call_commit_string(reply->context, text->str, 0, 0, -1, NULL, NULL, NULL);
+    g_string_free(text, TRUE);
+}
+
+
+static void schedule_replies(void);
+
+static gboolean
+replies_timeout(gpointer user_data G_GNUC_UNUSED)
+{
+    gint64 now = g_get_monotonic_time();
+    Reply *reply;
+
+    replies_timeout_id = 0;
+
+    while ((reply = g_queue_peek_head(&replies)) && reply->due <= now) {
+        g_queue_pop_head(&replies);
+        send_reply(reply);
+        maliit_server_complete_process_key_event(reply->server, reply->invocation);
+        reply_free(reply);
+    }
+
+    schedule_replies();
+    return G_SOURCE_REMOVE;
+}
+
+
+/* Replies are due in the order they were queued, as they all wait the
+ * same time, so one timeout for the oldest is enough. */
+static void
+schedule_replies(void)
+{
+    Reply *reply = g_queue_peek_head(&replies);
+    gint64 wait;
+
+    if (!reply || replies_timeout_id)
+        return;
+
+    wait = MAX(reply->due - g_get_monotonic_time(), 0);
+    replies_timeout_id = g_timeout_add((wait + 999) / 1000, replies_timeout, NULL);
+}
+
+
+/* Qt keys below the special ones are the Unicode character they type. */
+static gchar *
+key_text(gint key)
+{
+    gchar text[8];
+
+    if (key <= 0 || key >= QT_FIRST_SPECIAL_KEY || !g_unichar_validate(key) ||
+        g_unichar_iscntrl(key))
+        return g_strdup("");
+
+    text[g_unichar_to_utf8(key, text)] = '\0';
+    return g_strdup(text);
+}
+
+
+static gboolean
+handle_process_key_event(MaliitServer *server,
+                         GDBusMethodInvocation *invocation,
+                         gint type,
+                         gint key,
+                         gint modifiers,
+                         const gchar *text,
+                         gboolean auto_repeat G_GNUC_UNUSED,
+                         gint count,
+                         guint native_scan_code G_GNUC_UNUSED,
+                         guint native_modifiers G_GNUC_UNUSED,
+                         guint time G_GNUC_UNUSED,
+                         Client *client)
+{
+    Reply reply = {
+        g_object_ref(server),
+        invocation,
+        g_object_ref(client->context),
+        g_get_monotonic_time() + (gint64) reply_delay_ms * 1000,
+        type, key, modifiers, MAX(count, 1),
+        text && text[0] ? g_strdup(text) : key_text(key)
+    };
+
+    if (reply_delay_ms == 0) {
+        send_reply(&reply);
+        maliit_server_complete_process_key_event(server, invocation);
+        g_object_unref(reply.server);
+        g_object_unref(reply.context);
+        g_free(reply.text);
+        return TRUE;
+    }
+
+    g_queue_push_tail(&replies, g_slice_dup(Reply, &reply));
+    schedule_replies();
+
+    return TRUE;
+}
+
+
+static gboolean
+handle_activate_context(MaliitServer *server, GDBusMethodInvocation *invocation, Client *client)
+{
+    maliit_server_complete_activate_context(server, invocation);
+    maliit_context_call_set_redirect_keys(client->context, TRUE, NULL, NULL, NULL);
+    return TRUE;
+}
+
+
+static gboolean
+handle_update_widget_information(MaliitServer *server,
+                                 GDBusMethodInvocation *invocation,
+                                 GVariant *state_information G_GNUC_UNUSED,
+                                 gboolean focus_changed G_GNUC_UNUSED,
+                                 gpointer user_data G_GNUC_UNUSED)
+{
+    maliit_server_complete_update_widget_information(server, invocation);
+    return TRUE;
+}
+
+
+/* Calls without arguments that need nothing but an answer. */
+static gboolean
+handle_call(MaliitServer *server G_GNUC_UNUSED,
+            GDBusMethodInvocation *invocation,
+            gpointer user_data G_GNUC_UNUSED)
+{
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    return TRUE;
+}
+
+
+static void
+replay_call(guint index)
+{
+    GVariant *record = g_ptr_array_index(replay_records, index % replay_records->len);
+    const gchar *method;
+    GVariant *parameters;
+
+    g_variant_get(record, "(t&sv)", NULL, &method, &parameters);
+    g_dbus_proxy_call(G_DBUS_PROXY(replay_client->context), method, parameters,
+                      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    g_variant_unref(parameters);
+}
+
+
+static guint64
+record_time(guint index)
+{
+    guint64 time;
+
+    g_variant_get(g_ptr_array_index(replay_records, index % replay_records->len),
+                  "(t&sv)", &time, NULL, NULL);
+    return time;
+}
+
+
+/* One call at a time, each after the pause that preceded it when it was
+ * recorded. The repetitions follow each other without a pause. */
+static gboolean
+replay_timeout(gpointer user_data G_GNUC_UNUSED)
+{
+    guint total = replay_records->len * replay_repeat;
+    guint index = replay_next++;
+    guint64 pause;
+
+    if (!replay_client)
+        return G_SOURCE_REMOVE;
+
+    replay_call(index);
+
+    if (replay_next >= total)
+        return G_SOURCE_REMOVE;
+
+    pause = replay_next % replay_records->len == 0 ? 0 :
+            record_time(replay_next) - record_time(index);
+    g_timeout_add(pause / 1000, replay_timeout, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+start_replay(gpointer user_data G_GNUC_UNUSED)
+{
+    guint total = replay_records->len * replay_repeat;
+
+    if (!replay_client) {
+        fprintf(stderr, "No client to replay to\n");
+        return G_SOURCE_CONTINUE;
+    }
+
+    replay_next = 0;
+    if (replay_realtime) {
+        g_idle_add(replay_timeout, NULL);
+    } else {
+        while (replay_next < total)
+            replay_call(replay_next++);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+static void
+client_closed(GDBusConnection *connection G_GNUC_UNUSED,
+              gboolean remote_peer_vanished G_GNUC_UNUSED,
+              GError *error G_GNUC_UNUSED,
+              Client *client)
+{
+    if (replay_client == client)
+        replay_client = NULL;
+
+    g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(client->server));
+    g_object_unref(client->server);
+    g_object_unref(client->context);
+    g_object_unref(client->connection);
+    g_slice_free(Client, client);
+}
+
+
+static gboolean
+new_connection(GDBusServer *dbus_server G_GNUC_UNUSED,
+               GDBusConnection *connection,
+               gpointer user_data G_GNUC_UNUSED)
+{
+    Client *client = g_slice_new0(Client);
+    GError *error = NULL;
+
+    client->connection = g_object_ref(connection);
+    client->server = maliit_server_skeleton_new();
+    client->context = maliit_context_proxy_new_sync(connection,
+                                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                    G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                    NULL, CONTEXT_OBJECT_PATH, NULL, &error);
+    if (!client->context) {
+        g_warning("Unable to create the context proxy: %s", error->message);
+        g_clear_error(&error);
+        g_object_unref(client->server);
+        g_object_unref(client->connection);
+        g_slice_free(Client, client);
+        return FALSE;
+    }
+
+    g_signal_connect(client->server, "handle-activate-context",
+                     G_CALLBACK(handle_activate_context), client);
+    g_signal_connect(client->server, "handle-process-key-event",
+                     G_CALLBACK(handle_process_key_event), client);
+    g_signal_connect(client->server, "handle-update-widget-information",
+                     G_CALLBACK(handle_update_widget_information), client);
+    g_signal_connect(client->server, "handle-show-input-method", G_CALLBACK(handle_call), client);
+    g_signal_connect(client->server, "handle-hide-input-method", G_CALLBACK(handle_call), client);
+    g_signal_connect(client->server, "handle-reset", G_CALLBACK(handle_call), client);
+
+    if (!g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON(client->server),
+                                          connection, SERVER_OBJECT_PATH, &error)) {
+        g_warning("Unable to export the server: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    g_signal_connect(connection, "closed", G_CALLBACK(client_closed), client);
+    replay_client = client;
+
+    return TRUE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    gchar *mode = NULL;
+    gchar *address = NULL;
+    gchar *replay = NULL;
+    GOptionEntry entries[] = {
+        { "delay", 'd', 0, G_OPTION_ARG_INT, &reply_delay_ms,
+          "Milliseconds before a key comes back", "MS" },
+        { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode,
+          "How keys come back: commit, preedit or key", "MODE" },
+        { "address", 'a', 0, G_OPTION_ARG_STRING, &address,
+          "D-Bus address to listen on", "ADDRESS" },
+        { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &replay,
+          "Context record file to replay on SIGUSR1", "FILE" },
+        { "realtime", 't', 0, G_OPTION_ARG_NONE, &replay_realtime,
+          "Replay at the recorded pace", NULL },
+        { "repeat", 'n', 0, G_OPTION_ARG_INT, &replay_repeat,
+          "Replay the record this many times", "N" },
+        { NULL }
+    };
+    GOptionContext *options = g_option_context_new("- stand-in Maliit server");
+    GDBusServer *dbus_server;
+    GMainLoop *loop;
+    GError *error = NULL;
+    gchar *guid;
+
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    if (!mode || strcmp(mode, "commit") == 0) {
+        reply_mode = REPLY_COMMIT;
+    } else if (strcmp(mode, "preedit") == 0) {
+        reply_mode = REPLY_PREEDIT;
+    } else if (strcmp(mode, "key") == 0) {
+        reply_mode = REPLY_KEY;
+    } else {
+        fprintf(stderr, "Unknown mode %s\n", mode);
+        return 1;
+    }
+
+    if (replay) {
+        replay_records = bench_context_record_read(replay);
+        if (!replay_records || replay_records->len == 0 || replay_repeat < 1) {
+            fprintf(stderr, "Nothing to replay\n");
+            return 1;
+        }
+        g_unix_signal_add(SIGUSR1, start_replay, NULL);
+    }
+
+    guid = g_dbus_generate_guid();
+    dbus_server = g_dbus_server_new_sync(address ? address : "unix:tmpdir=/tmp",
+                                         G_DBUS_SERVER_FLAGS_NONE, guid,
+                                         NULL, NULL, &error);
+    g_free(guid);
+    if (!dbus_server) {
+        fprintf(stderr, "Unable to listen: %s\n", error->message);
+        return 1;
+    }
+
+    g_signal_connect(dbus_server, "new-connection", G_CALLBACK(new_connection), NULL);
+    g_dbus_server_start(dbus_server);
+
+    printf("%s\n", g_dbus_server_get_client_address(dbus_server));
+    fflush(stdout);
+
+    loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(loop);
+
+    return 0;
+}
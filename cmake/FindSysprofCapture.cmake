@@ -0,0 +1,26 @@
+find_package(PkgConfig)
+pkg_check_modules(PC_SYSPROF_CAPTURE sysprof-capture-4 QUIET)
+
+set(SYSPROF_CAPTURE_DEFINITIONS ${PC_SYSPROF_CAPTURE_CFLAGS_OTHER})
+set(SYSPROF_CAPTURE_INCLUDE_DIRS ${PC_SYSPROF_CAPTURE_INCLUDE_DIRS})
+
+foreach(COMP ${PC_SYSPROF_CAPTURE_LIBRARIES})
+    find_library(SYSPROF_CAPTURE_${COMP} NAMES ${COMP} HINTS ${PC_SYSPROF_CAPTURE_LIBRARY_DIRS})
+    list(APPEND SYSPROF_CAPTURE_LIBRARIES ${SYSPROF_CAPTURE_${COMP}})
+endforeach()
+
+# handle the QUIETLY and REQUIRED arguments and set SYSPROF_CAPTURE_FOUND to TRUE if
+# all listed variables are TRUE
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(SYSPROF_CAPTURE DEFAULT_MSG SYSPROF_CAPTURE_LIBRARIES SYSPROF_CAPTURE_INCLUDE_DIRS)
+
+mark_as_advanced(SYSPROF_CAPTURE_INCLUDE_DIRS SYSPROF_CAPTURE_LIBRARIES)
+
+if(PC_SYSPROF_CAPTURE_FOUND AND NOT TARGET Sysprof::Capture)
+    add_library(Sysprof::Capture INTERFACE IMPORTED)
+
+    set_property(TARGET Sysprof::Capture PROPERTY INTERFACE_COMPILE_DEFINITIONS HAVE_SYSPROF)
+    set_property(TARGET Sysprof::Capture PROPERTY INTERFACE_COMPILE_OPTIONS "-pthread")
+    set_property(TARGET Sysprof::Capture PROPERTY INTERFACE_INCLUDE_DIRECTORIES ${SYSPROF_CAPTURE_INCLUDE_DIRS})
+    set_property(TARGET Sysprof::Capture PROPERTY INTERFACE_LINK_LIBRARIES ${SYSPROF_CAPTURE_LIBRARIES})
+endif()
@@ -0,0 +1,714 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include <maliit-glib/maliitbus.h>
+
+#include "client-connection.h"
+#include "context-record.h"
+#include "metrics.h"
+#include "trace.h"
+#include "debug.h"
+
+typedef enum {
+    CONNECTION_IDLE,
+    CONNECTION_CONNECTING,
+    CONNECTION_READY
+} ConnectionState;
+
+typedef enum {
+    SERVER_NAME_UNKNOWN,
+    SERVER_NAME_OWNED,
+    SERVER_NAME_UNOWNED
+} ServerNameState;
+
+typedef enum {
+    PENDING_ACTIVATE_CONTEXT,
+    PENDING_UPDATE_WIDGET_INFORMATION,
+    PENDING_RESET,
+    PENDING_SHOW_INPUT_METHOD,
+    PENDING_HIDE_INPUT_METHOD,
+    PENDING_PROCESS_KEY_EVENT
+} PendingCallType;
+
+typedef struct {
+    gint type;
+    gint key;
+    gint modifiers;
+    gchar *text;
+    gboolean auto_repeat;
+    gint count;
+    guint native_scan_code;
+    guint native_modifiers;
+    guint time;
+    guint trace_sequence;
+} KeyEvent;
+
+typedef struct {
+    PendingCallType type;
+    GVariant *widget_state;
+    gboolean focus_changed;
+    KeyEvent key_event;
+} PendingCall;
+
+/* Key events not answered by the server yet. Past this, key events wait
+ * in the queue, where auto-repeated presses are folded together. */
+#define MAX_KEY_EVENTS_IN_FLIGHT 4
+
+/* Owned on the session bus by the server, which publishes its own
+ * address there. */
+#define MALIIT_SERVER_NAME "org.maliit.server"
+
+static ConnectionState state = CONNECTION_IDLE;
+static MaliitServer *server = NULL;
+static MaliitContext *context = NULL;
+static MaliitAttributeExtensionRegistry *registry = NULL;
+static GQueue pending_calls = G_QUEUE_INIT;
+static GVariant *sent_widget_state = NULL;
+static guint prewarm_id = 0;
+static guint flush_id = 0;
+static guint key_events_in_flight = 0;
+static gboolean input_method_shown = FALSE;
+static gboolean server_composing = FALSE;
+static GDBusConnection *server_connection = NULL;
+static ServerNameState server_name = SERVER_NAME_UNKNOWN;
+static guint server_name_watch_id = 0;
+static gboolean resync_pending = FALSE;
+static gboolean resync_shown = FALSE;
+
+static MaliitConnectionReadyFunc ready_func = NULL;
+static gpointer ready_func_data = NULL;
+
+
+static void
+pending_call_free(gpointer data)
+{
+    PendingCall *call = data;
+
+    if (call->widget_state)
+        g_variant_unref(call->widget_state);
+
+    g_free(call->key_event.text);
+    g_slice_free(PendingCall, call);
+}
+
+
+static void flush_pending_calls(void);
+static gboolean key_events_pending(void);
+static void connection_closed(GDBusConnection *connection, gboolean remote_peer_vanished,
+                              GError *error, gpointer user_data);
+
+/* Bytes of surrounding text in the widget state, for the metrics. */
+static gsize
+surrounding_text_length(GVariant *widget_state)
+{
+    GVariant *text = g_variant_lookup_value(widget_state, "surroundingText", G_VARIANT_TYPE_STRING);
+    gsize length = 0;
+
+    if (text) {
+        g_variant_get_string(text, &length);
+        g_variant_unref(text);
+    }
+
+    return length;
+}
+
+static void
+key_event_processed(GObject *source_object, GAsyncResult *res, gpointer user_data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+
+    if (!maliit_server_call_process_key_event_finish(MALIIT_SERVER(source_object), res, &error)) {
+        DBG(DBUS, "processKeyEvent failed: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    /* Dropped to 0 when the connection was lost in between. */
+    if (key_events_in_flight > 0)
+        key_events_in_flight--;
+
+    /* The server commits the text of a key before it answers, so a key
+     * without a commit by now is not going to get one. */
+    if (!key_events_pending())
+        maliit_metrics_cancel(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
+
+    if (state == CONNECTION_READY)
+        flush_pending_calls();
+}
+
+
+static void
+send_call(const PendingCall *call)
+{
+    const KeyEvent *key_event = &call->key_event;
+
+    switch (call->type) {
+    case PENDING_ACTIVATE_CONTEXT:
+        MALIIT_COUNT(MALIIT_COUNTER_ACTIVATE_CONTEXT);
+        maliit_server_call_activate_context(server, NULL, NULL, NULL);
+        break;
+    case PENDING_UPDATE_WIDGET_INFORMATION:
+        MALIIT_COUNT(MALIIT_COUNTER_UPDATE_WIDGET_INFORMATION);
+        MALIIT_COUNT_N(MALIIT_COUNTER_SURROUNDING_TEXT_BYTES, surrounding_text_length(call->widget_state));
+        maliit_server_call_update_widget_information(server, call->widget_state, call->focus_changed,
+                                                     NULL, NULL, NULL);
+        break;
+    case PENDING_RESET:
+        MALIIT_COUNT(MALIIT_COUNTER_RESET);
+        maliit_server_call_reset(server, NULL, NULL, NULL);
+        break;
+    case PENDING_SHOW_INPUT_METHOD:
+        MALIIT_COUNT(MALIIT_COUNTER_SHOW_INPUT_METHOD);
+        maliit_metrics_end(MALIIT_HISTOGRAM_FOCUS_TO_SHOW);
+        maliit_server_call_show_input_method(server, NULL, NULL, NULL);
+        break;
+    case PENDING_HIDE_INPUT_METHOD:
+        MALIIT_COUNT(MALIIT_COUNTER_HIDE_INPUT_METHOD);
+        maliit_server_call_hide_input_method(server, NULL, NULL, NULL);
+        break;
+    case PENDING_PROCESS_KEY_EVENT:
+        MALIIT_TRACE_SEQUENCE(MALIIT_TRACE_PROCESS_KEY_EVENT, key_event->trace_sequence);
+        MALIIT_COUNT(MALIIT_COUNTER_PROCESS_KEY_EVENT);
+        key_events_in_flight++;
+        maliit_server_call_process_key_event(server,
+                                             key_event->type,
+                                             key_event->key,
+                                             key_event->modifiers,
+                                             key_event->text,
+                                             key_event->auto_repeat,
+                                             key_event->count,
+                                             key_event->native_scan_code,
+                                             key_event->native_modifiers,
+                                             key_event->time,
+                                             NULL,
+                                             key_event_processed,
+                                             NULL);
+        break;
+    }
+}
+
+
+/* Sends queued calls in order, stopping at a key event while too many are
+ * still unanswered; its completion resumes the flush. All calls go out on
+ * the one D-Bus connection, which keeps them in order. */
+static void
+flush_pending_calls(void)
+{
+    PendingCall *call;
+
+    while ((call = g_queue_peek_head(&pending_calls))) {
+        if (call->type == PENDING_PROCESS_KEY_EVENT &&
+            key_events_in_flight >= MAX_KEY_EVENTS_IN_FLIGHT) {
+            DBG(KEYS, "%u key events in flight, %u calls waiting",
+                key_events_in_flight, g_queue_get_length(&pending_calls));
+            return;
+        }
+
+        g_queue_pop_head(&pending_calls);
+        send_call(call);
+        pending_call_free(call);
+    }
+}
+
+
+static gboolean
+flush_idle(gpointer user_data G_GNUC_UNUSED)
+{
+    flush_id = 0;
+
+    if (state == CONNECTION_READY)
+        flush_pending_calls();
+
+    return G_SOURCE_REMOVE;
+}
+
+
+static void
+queue_call(PendingCallType type, GVariant *widget_state, gboolean focus_changed)
+{
+    PendingCall call = { type, widget_state, focus_changed, { 0 } };
+
+    /* Nothing may overtake what is queued already. */
+    if (state == CONNECTION_READY && g_queue_is_empty(&pending_calls)) {
+        send_call(&call);
+        return;
+    }
+
+    g_queue_push_tail(&pending_calls, g_slice_dup(PendingCall, &call));
+    if (widget_state)
+        g_variant_ref(widget_state);
+
+    DBG(DBUS, "queued call %d, %u pending", type, g_queue_get_length(&pending_calls));
+
+    maliit_connection_connect();
+}
+
+
+static void
+connection_failed(const char *what, GError *error)
+{
+    g_warning("Unable to connect to %s: %s", what, error->message);
+    g_clear_error(&error);
+
+    g_clear_object(&server);
+    g_clear_object(&context);
+    g_clear_pointer(&sent_widget_state, g_variant_unref);
+
+    /* Nobody is going to receive these; the next call retries. */
+    g_queue_clear_full(&pending_calls, pending_call_free);
+    key_events_in_flight = 0;
+    input_method_shown = FALSE;
+    server_composing = FALSE;
+    state = CONNECTION_IDLE;
+
+    maliit_metrics_cancel(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
+    maliit_metrics_cancel(MALIIT_HISTOGRAM_FOCUS_TO_SHOW);
+}
+
+
+/* The server exited or crashed. Whether it showed the input method is
+ * kept, and the focused context replayed once connected again, which
+ * happens in the background as soon as the server is back on the bus.
+ * Not before: the connection closes ahead of the name being released,
+ * and connecting right away would reach for the server that is gone. */
+static void
+connection_closed(GDBusConnection *connection,
+                  gboolean remote_peer_vanished G_GNUC_UNUSED,
+                  GError *error G_GNUC_UNUSED,
+                  gpointer user_data G_GNUC_UNUSED)
+{
+    DBG(DBUS, "connection to the server closed");
+
+    g_signal_handlers_disconnect_by_func(connection, connection_closed, NULL);
+    g_clear_object(&server_connection);
+    maliit_context_record_detach();
+
+    resync_pending = TRUE;
+    resync_shown = input_method_shown;
+
+    g_clear_object(&server);
+    g_clear_object(&context);
+    g_clear_pointer(&sent_widget_state, g_variant_unref);
+    g_queue_clear_full(&pending_calls, pending_call_free);
+    key_events_in_flight = 0;
+    input_method_shown = FALSE;
+    server_composing = FALSE;
+    state = CONNECTION_IDLE;
+
+    maliit_metrics_cancel(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
+    maliit_metrics_cancel(MALIIT_HISTOGRAM_FOCUS_TO_SHOW);
+
+    /* The next connection looks the server's address up again. */
+    maliit_set_bus(NULL);
+}
+
+
+static void
+got_context(GObject *source_object G_GNUC_UNUSED, GAsyncResult *res, gpointer user_data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+
+    context = maliit_get_context_finish(res, &error);
+    if (!context) {
+        connection_failed("context", error);
+        return;
+    }
+
+    STEP(DBUS);
+    state = CONNECTION_READY;
+
+    server_connection = g_object_ref(g_dbus_proxy_get_connection(G_DBUS_PROXY(server)));
+    g_signal_connect(server_connection, "closed", G_CALLBACK(connection_closed), NULL);
+
+    if (maliit_context_record_enabled)
+        maliit_context_record_attach(context);
+
+    if (ready_func)
+        ready_func(server, context, ready_func_data);
+
+    flush_pending_calls();
+}
+
+
+static void
+got_server(GObject *source_object G_GNUC_UNUSED, GAsyncResult *res, gpointer user_data G_GNUC_UNUSED)
+{
+    GError *error = NULL;
+
+    server = maliit_get_server_finish(res, &error);
+    if (!server) {
+        connection_failed("server", error);
+        return;
+    }
+
+    maliit_get_context(NULL, got_context, NULL);
+}
+
+
+void
+maliit_connection_connect(void)
+{
+    if (state != CONNECTION_IDLE)
+        return;
+
+    STEP(DBUS);
+    state = CONNECTION_CONNECTING;
+    maliit_get_server(NULL, got_server, NULL);
+}
+
+
+static void
+server_name_appeared(GDBusConnection *connection G_GNUC_UNUSED,
+                     const gchar *name G_GNUC_UNUSED,
+                     const gchar *name_owner G_GNUC_UNUSED,
+                     gpointer user_data G_GNUC_UNUSED)
+{
+    DBG(DBUS, "server on the bus");
+    server_name = SERVER_NAME_OWNED;
+
+    if (resync_pending)
+        maliit_connection_connect();
+}
+
+
+static void
+server_name_vanished(GDBusConnection *connection G_GNUC_UNUSED,
+                     const gchar *name G_GNUC_UNUSED,
+                     gpointer user_data G_GNUC_UNUSED)
+{
+    DBG(DBUS, "server not on the bus");
+    server_name = SERVER_NAME_UNOWNED;
+}
+
+
+void
+maliit_connection_watch_server(void)
+{
+    if (server_name_watch_id)
+        return;
+
+    server_name_watch_id = g_bus_watch_name(G_BUS_TYPE_SESSION, MALIIT_SERVER_NAME,
+                                            G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                            server_name_appeared, server_name_vanished,
+                                            NULL, NULL);
+}
+
+
+/* A connection made to a server set with maliit_set_bus(), which has no
+ * name on the session bus, counts as well. Until the watch reports, the
+ * server is assumed to be there, on purpose. The first focus usually
+ * comes before the report; its calls are queued and go out as soon as
+ * the connection is up. A server set with maliit_set_bus() is only ever
+ * reached that way. If there is no server, the one attempt fails and
+ * drops the queue. */
+gboolean
+maliit_connection_is_running(void)
+{
+    return state == CONNECTION_READY || server_name != SERVER_NAME_UNOWNED;
+}
+
+
+void
+maliit_connection_set_resync(gboolean focused)
+{
+    resync_pending = focused;
+    resync_shown = focused;
+}
+
+
+/* Calls queued since the connection was lost come from a later focus
+ * change, and supersede the replay. */
+gboolean
+maliit_connection_take_resync(gboolean *shown)
+{
+    gboolean replay = resync_pending && g_queue_is_empty(&pending_calls);
+
+    resync_pending = FALSE;
+    *shown = resync_shown;
+
+    return replay;
+}
+
+
+static gboolean
+prewarm_idle(gpointer user_data G_GNUC_UNUSED)
+{
+    prewarm_id = 0;
+    maliit_connection_connect();
+    return G_SOURCE_REMOVE;
+}
+
+
+void
+maliit_connection_prewarm(void)
+{
+    const char *prewarm = g_getenv("MALIIT_PREWARM");
+
+    if (prewarm && strcmp(prewarm, "0") == 0)
+        return;
+
+    if (!prewarm_id && state == CONNECTION_IDLE)
+        prewarm_id = g_idle_add_full(G_PRIORITY_LOW, prewarm_idle, NULL, NULL);
+}
+
+
+void
+maliit_connection_set_ready_func(MaliitConnectionReadyFunc func, gpointer user_data)
+{
+    ready_func = func;
+    ready_func_data = user_data;
+}
+
+
+gboolean
+maliit_connection_is_ready(void)
+{
+    return state == CONNECTION_READY;
+}
+
+
+MaliitServer *
+maliit_connection_get_server(void)
+{
+    if (state != CONNECTION_READY) {
+        maliit_connection_connect();
+        return NULL;
+    }
+
+    return server;
+}
+
+
+MaliitContext *
+maliit_connection_get_context(void)
+{
+    if (state != CONNECTION_READY) {
+        maliit_connection_connect();
+        return NULL;
+    }
+
+    return context;
+}
+
+
+MaliitAttributeExtensionRegistry *
+maliit_connection_get_registry(void)
+{
+    if (!registry)
+        registry = maliit_attribute_extension_registry_get_instance();
+
+    return registry;
+}
+
+
+void
+maliit_connection_activate_context(void)
+{
+    queue_call(PENDING_ACTIVATE_CONTEXT, NULL, FALSE);
+}
+
+
+/* Whether any key of the widget state was added, removed or changed. */
+static gboolean
+widget_state_changed(GVariant *old_state, GVariant *new_state)
+{
+    GVariantIter iter;
+    const gchar *key;
+    GVariant *value;
+    gboolean changed = FALSE;
+
+    if (g_variant_n_children(old_state) != g_variant_n_children(new_state))
+        return TRUE;
+
+    g_variant_iter_init(&iter, new_state);
+    while (!changed && g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+        GVariant *old_value = g_variant_lookup_value(old_state, key, NULL);
+
+        changed = !old_value || !g_variant_equal(old_value, value);
+        if (changed)
+            DBG(WIDGET_INFO, "%s changed", key);
+
+        if (old_value)
+            g_variant_unref(old_value);
+        g_variant_unref(value);
+    }
+
+    return changed;
+}
+
+
+/* The server replaces its whole copy of the widget state on every update,
+ * so the state cannot be sent key by key. What is sent is remembered
+ * instead, and updates that change no key are not sent at all. Focus
+ * changes always go through, as a full resync. */
+void
+maliit_connection_update_widget_information(GVariant *widget_state, gboolean focus_changed)
+{
+    if (!focus_changed && sent_widget_state &&
+        !widget_state_changed(sent_widget_state, widget_state)) {
+        DBG(WIDGET_INFO, "widget state unchanged, not sent");
+        MALIIT_COUNT(MALIIT_COUNTER_WIDGET_INFORMATION_SKIPPED);
+        return;
+    }
+
+    if (sent_widget_state)
+        g_variant_unref(sent_widget_state);
+    sent_widget_state = g_variant_ref(widget_state);
+
+    queue_call(PENDING_UPDATE_WIDGET_INFORMATION, widget_state, focus_changed);
+}
+
+
+static gboolean
+key_events_pending(void)
+{
+    GList *l;
+
+    if (key_events_in_flight > 0)
+        return TRUE;
+
+    for (l = pending_calls.head; l; l = l->next) {
+        if (((PendingCall *) l->data)->type == PENDING_PROCESS_KEY_EVENT)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/* The server calls updatePreedit and commitString while handling a key
+ * event, ahead of its reply on the same connection. Once every key event
+ * is answered, what it last reported is therefore all it is composing. */
+gboolean
+maliit_connection_server_is_clean(void)
+{
+    return !server_composing && !key_events_pending();
+}
+
+
+void
+maliit_connection_server_preedit_changed(gboolean composing)
+{
+    server_composing = composing;
+}
+
+
+/* GTK resets a context on every click, selection change and programmatic
+ * edit; most of the time the server has nothing to drop. */
+void
+maliit_connection_reset(void)
+{
+    if (maliit_connection_server_is_clean()) {
+        DBG(PREEDIT, "server has nothing to reset");
+        MALIIT_COUNT(MALIIT_COUNTER_RESET_SKIPPED);
+        return;
+    }
+
+    server_composing = FALSE;
+    queue_call(PENDING_RESET, NULL, FALSE);
+}
+
+
+void
+maliit_connection_show_input_method(void)
+{
+    if (input_method_shown) {
+        DBG(FOCUS, "input method shown already");
+        MALIIT_COUNT(MALIIT_COUNTER_SHOW_SKIPPED);
+        maliit_metrics_cancel(MALIIT_HISTOGRAM_FOCUS_TO_SHOW);
+        return;
+    }
+
+    input_method_shown = TRUE;
+    queue_call(PENDING_SHOW_INPUT_METHOD, NULL, FALSE);
+}
+
+
+void
+maliit_connection_hide_input_method(void)
+{
+    input_method_shown = FALSE;
+    queue_call(PENDING_HIDE_INPUT_METHOD, NULL, FALSE);
+}
+
+
+gboolean
+maliit_connection_input_method_shown(void)
+{
+    return input_method_shown;
+}
+
+
+void
+maliit_connection_input_method_hidden(void)
+{
+    input_method_shown = FALSE;
+}
+
+
+/* Whether the key event can be folded into the queued one: another
+ * auto-repeated press of the same key, which the server then sees once
+ * with a higher count. */
+static gboolean
+key_event_repeats(const KeyEvent *queued, const KeyEvent *key_event)
+{
+    return queued->auto_repeat && key_event->auto_repeat &&
+           queued->type == key_event->type &&
+           queued->key == key_event->key &&
+           queued->modifiers == key_event->modifiers &&
+           queued->native_scan_code == key_event->native_scan_code &&
+           queued->native_modifiers == key_event->native_modifiers &&
+           g_strcmp0(queued->text, key_event->text) == 0;
+}
+
+
+/* Key events are never sent right away: they are queued behind any other
+ * call and flushed once the events of this main loop iteration have been
+ * dispatched, so a burst of them leaves in one go. */
+void
+maliit_connection_process_key_event(gint type, gint key, gint modifiers, const gchar *text,
+                                    gboolean auto_repeat, gint count, guint native_scan_code,
+                                    guint native_modifiers, guint time)
+{
+    KeyEvent key_event = {
+        type, key, modifiers, (gchar *) text, auto_repeat, count,
+        native_scan_code, native_modifiers, time, maliit_trace_sequence()
+    };
+    PendingCall *tail = g_queue_peek_tail(&pending_calls);
+    PendingCall *call;
+
+    if (tail && tail->type == PENDING_PROCESS_KEY_EVENT &&
+        key_event_repeats(&tail->key_event, &key_event)) {
+        tail->key_event.count += count;
+        tail->key_event.time = time;
+        DBG(KEYS, "auto-repeat folded, count %d", tail->key_event.count);
+        MALIIT_COUNT(MALIIT_COUNTER_KEY_EVENTS_FOLDED);
+        return;
+    }
+
+    call = g_slice_new0(PendingCall);
+    call->type = PENDING_PROCESS_KEY_EVENT;
+    call->key_event = key_event;
+    call->key_event.text = g_strdup(text);
+    g_queue_push_tail(&pending_calls, call);
+
+    if (state != CONNECTION_READY)
+        maliit_connection_connect();
+    else if (!flush_id)
+        /* Below the priority of the event sources, above that of redraws. */
+        flush_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, flush_idle, NULL, NULL);
+}
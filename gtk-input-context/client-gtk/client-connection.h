@@ -0,0 +1,91 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _CLIENT_CONNECTION_H
+#define _CLIENT_CONNECTION_H
+
+#include <glib.h>
+#include <maliit-glib/maliitserver.h>
+#include <maliit-glib/maliitcontext.h>
+#include <maliit-glib/maliitattributeextensionregistry.h>
+
+G_BEGIN_DECLS
+
+/* The connection is process-wide: it owns the only server and context
+ * proxies, and the ready function is where the single handler of each of
+ * their signals gets connected. Called once both proxies are available. */
+typedef void (*MaliitConnectionReadyFunc)(MaliitServer *server, MaliitContext *context, gpointer user_data);
+
+void maliit_connection_set_ready_func(MaliitConnectionReadyFunc func, gpointer user_data);
+
+/* Start connecting from an idle callback, ahead of the first focus. */
+void maliit_connection_prewarm(void);
+
+/* Start connecting if that is not under way yet. Never blocks. */
+void maliit_connection_connect(void);
+
+/* Whether the server can be reached, from a watch on its bus name
+ * rather than a round trip. When the connection to the server is lost,
+ * it is made again in the background once the server is back, and the
+ * focused context replayed. */
+void maliit_connection_watch_server(void);
+gboolean maliit_connection_is_running(void);
+
+/* The focus moved while the server was away: a context is to be replayed,
+ * and the input method shown, once it is back, or none is. */
+void maliit_connection_set_resync(gboolean focused);
+
+/* For the ready func: whether to replay the focused context, and whether
+ * to show the input method after it. */
+gboolean maliit_connection_take_resync(gboolean *shown);
+
+gboolean maliit_connection_is_ready(void);
+MaliitServer *maliit_connection_get_server(void);
+MaliitContext *maliit_connection_get_context(void);
+MaliitAttributeExtensionRegistry *maliit_connection_get_registry(void);
+
+/* Server calls. Made right away when connected, otherwise queued and sent
+ * in order as soon as the connection is up. */
+void maliit_connection_activate_context(void);
+void maliit_connection_update_widget_information(GVariant *widget_state, gboolean focus_changed);
+void maliit_connection_reset(void);
+void maliit_connection_show_input_method(void);
+void maliit_connection_hide_input_method(void);
+
+/* Whether the server has no composition going on: no preedit reported,
+ * or dropped by a reset since, and no key event left unanswered. reset
+ * is then not sent. Tracked from the updatePreedit and commitString the
+ * server sends, which report whether it is composing. */
+gboolean maliit_connection_server_is_clean(void);
+void maliit_connection_server_preedit_changed(gboolean composing);
+
+/* Shown or hidden, as last asked of the server: showInputMethod is not
+ * sent again while shown. The server may hide the input method by
+ * itself, which it then reports with imInitiatedHide. */
+gboolean maliit_connection_input_method_shown(void);
+void maliit_connection_input_method_hidden(void);
+
+/* Key events are queued with the other calls, so they keep their order,
+ * and are sent from an idle callback. Only a few are left unanswered by
+ * the server at a time; the rest wait, and auto-repeated presses of the
+ * same key are meanwhile folded into one event with a higher count. */
+void maliit_connection_process_key_event(gint type, gint key, gint modifiers, const gchar *text,
+                                         gboolean auto_repeat, gint count, guint native_scan_code,
+                                         guint native_modifiers, guint time);
+
+G_END_DECLS
+
+#endif //_CLIENT_CONNECTION_H
@@ -22,6 +22,9 @@
  */
 
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <gdk/gdk.h>
 #include <maliit-glib/maliitbus.h>
 
@@ -30,7 +33,13 @@
 #endif /* HAVE_X11 */
 
 #include "client-imcontext-gtk.h"
+#include "client-connection.h"
+#include "key-record.h"
+#include "preedit-attrs.h"
 #include "qt-gtk-translate.h"
+#include "surrounding-text.h"
+#include "metrics.h"
+#include "trace.h"
 #include "debug.h"
 
 static GType _maliit_im_context_type = 0;
@@ -38,6 +47,9 @@ static GtkIMContextClass *parent_class = NULL;
 
 static MaliitIMContext *focused_im_context = NULL;
 static GtkWidget *focused_widget = NULL;
+static MaliitIMContext *unfocused_im_context = NULL;
+static guint focus_out_timeout_id = 0;
+static guint16 pressed_keycode = 0;
 
 gboolean redirect_keys = FALSE;
 
@@ -54,7 +66,27 @@ static void maliit_im_context_get_preedit_string(GtkIMContext *context, gchar **
 static void maliit_im_context_set_preedit_enabled(GtkIMContext *context, gboolean enabled);
 static void maliit_im_context_set_client_window(GtkIMContext *context, GdkWindow *window);
 static void maliit_im_context_set_cursor_location(GtkIMContext *context, GdkRectangle *area);
-static void maliit_im_context_update_widget_info(MaliitIMContext *im_context);
+static void maliit_im_context_send_widget_info(MaliitIMContext *im_context, gboolean focus_changed);
+static void maliit_im_context_queue_widget_info(MaliitIMContext *im_context);
+static void maliit_im_context_flush_widget_info(MaliitIMContext *im_context);
+static void maliit_im_context_cancel_widget_info(MaliitIMContext *im_context);
+static void maliit_im_context_queue_preedit_changed(MaliitIMContext *im_context);
+static void maliit_im_context_flush_preedit_changed(MaliitIMContext *im_context);
+static void maliit_im_context_cancel_preedit_changed(MaliitIMContext *im_context);
+static void maliit_im_context_clear_preedit(MaliitIMContext *im_context);
+#if GTK_MAJOR_VERSION == 3
+static void release_frame_clock(MaliitIMContext *im_context);
+#endif /* GTK_MAJOR_VERSION */
+static guint focus_out_delay(void);
+static void maliit_im_context_flush_focus_out(void);
+static gboolean maliit_im_context_cancel_focus_out(void);
+static gboolean maliit_im_context_commit_preedit(MaliitIMContext *im_context);
+static MaliitIMContextState *maliit_im_context_get_state(MaliitIMContext *im_context);
+static void maliit_im_context_queue_release_state(MaliitIMContext *im_context);
+static void maliit_im_context_release_state(MaliitIMContext *im_context);
+static void maliit_im_context_invalidate_surrounding_text(MaliitIMContext *im_context);
+static gboolean maliit_im_context_delete_surrounding(GSignalInvocationHint *hint, guint n_param_values,
+                                                     const GValue *param_values, gpointer user_data);
 
 static gboolean maliit_im_context_im_initiated_hide(MaliitContext *obj, GDBusMethodInvocation *invocation, gpointer user_data);
 static gboolean maliit_im_context_commit_string(MaliitContext *obj, GDBusMethodInvocation *invocation, const gchar *string,
@@ -75,6 +107,7 @@ static gboolean maliit_im_context_notify_extended_attribute_changed (MaliitConte
 static gboolean maliit_im_context_update_input_method_area (MaliitContext *obj, GDBusMethodInvocation *invocation,
                                                           gint x, gint y, gint width, gint height, gpointer user_data);
 static void maliit_im_context_invoke_action(MaliitServer *obj, const char *action, const char* sequence, gpointer user_data);
+static void maliit_im_context_connection_ready(MaliitServer *server, MaliitContext *context, gpointer user_data);
 
 static GtkIMContext *maliit_im_context_get_slave_imcontext(void);
 
@@ -86,6 +119,31 @@ static const gchar *const WIDGET_INFO_ATTRIBUTE_EXTENSION_ID = "toolbarId";
 static const gchar *const WIDGET_INFO_ATTRIBUTE_EXTENSION_FILENAME = "toolbar";
 static const gchar *const WIDGET_INFO_SURROUNDING_TEXT = "surroundingText";
 static const gchar *const WIDGET_INFO_CURSOR_POSITION = "cursorPosition";
+static const gchar *const WIDGET_INFO_SURROUNDING_TEXT_OFFSET = "surroundingTextOffset";
+
+/* How long a queued widget state update may wait when there is no frame
+ * clock to pace it: about one frame at 60Hz. */
+static const guint WIDGET_INFO_FLUSH_INTERVAL_MS = 16;
+
+/* Without a frame clock, preedit-changed is emitted from an idle that runs
+ * just ahead of GDK's redraws (G_PRIORITY_HIGH_IDLE + 20). */
+static const gint PREEDIT_CHANGED_PRIORITY = G_PRIORITY_HIGH_IDLE + 10;
+
+/* Moving the focus between two widgets, or through a popup and back, is a
+ * focus-out followed at once by a focus-in. The focus-out is held back for
+ * this long so that the pair becomes a single context switch, rather than
+ * a hide and a show which would make the keyboard flicker. */
+#define DEFAULT_FOCUS_OUT_DELAY_MS 100
+
+/* How long a context keeps its state once unfocused, so that focus going
+ * back and forth between a few widgets does not keep rebuilding it. */
+static const guint STATE_RELEASE_DELAY_S = 30;
+
+/* Released states are kept for reuse, up to this many. */
+#define STATE_POOL_SIZE 4
+
+static MaliitIMContextState *state_pool[STATE_POOL_SIZE];
+static guint state_pool_length = 0;
 
 
 GType maliit_im_context_get_type()
@@ -139,8 +197,10 @@ slave_commit(GtkIMContext *slave, const char *text, gpointer data)
 {
     UNUSED(slave);
     UNUSED(data);
-    DBG("text = %s", text);
+    DBG(KEYS, "text = %s", text);
     if (focused_im_context && text) {
+        maliit_im_context_invalidate_surrounding_text(focused_im_context);
+        MALIIT_TRACE(MALIIT_TRACE_EMIT_COMMIT);
         g_signal_emit_by_name(focused_im_context, "commit", text);
     }
 }
@@ -154,7 +214,7 @@ slave_preedit_changed(GtkIMContext *slave, gpointer data)
     gint cursor_pos = 0;
     PangoAttrList *attrs = NULL;
 
-    STEP();
+    STEP(PREEDIT);
     if (!focused_im_context || !slave)
         return;
 
@@ -171,7 +231,10 @@ slave_preedit_changed(GtkIMContext *slave, gpointer data)
         pango_attr_list_unref(focused_im_context->preedit_attrs);
 
     focused_im_context->preedit_attrs = attrs;
+    g_clear_pointer(&focused_im_context->preedit_format, g_variant_unref);
 
+    maliit_im_context_invalidate_surrounding_text(focused_im_context);
+    maliit_im_context_cancel_preedit_changed(focused_im_context);
     g_signal_emit_by_name(focused_im_context, "preedit-changed");
 }
 
@@ -205,13 +268,14 @@ maliit_im_context_dispose(GObject *object)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(object);
 
-    if (im_context->context)
-        g_signal_handlers_disconnect_by_data (im_context->context, object);
-    if (im_context->server)
-        g_signal_handlers_disconnect_by_data (im_context->server, object);
+    if (focused_im_context == im_context)
+        focused_im_context = NULL;
+    if (unfocused_im_context == im_context)
+        maliit_im_context_flush_focus_out();
+    maliit_im_context_release_state(im_context);
 
-    g_clear_object(&im_context->context);
-    g_clear_object(&im_context->server);
+    maliit_im_context_cancel_widget_info(im_context);
+    maliit_im_context_cancel_preedit_changed(im_context);
 
     G_OBJECT_CLASS(parent_class)->dispose(object);
 }
@@ -221,15 +285,15 @@ maliit_im_context_finalize(GObject *object)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(object);
 
-    if (im_context->widget_state)
-        g_variant_unref(im_context->widget_state);
+    g_free(im_context->preedit_str);
+    if (im_context->preedit_attrs)
+        pango_attr_list_unref(im_context->preedit_attrs);
+    if (im_context->preedit_format)
+        g_variant_unref(im_context->preedit_format);
 
     if (im_context->client_window)
         g_object_unref(im_context->client_window);
 
-    if (im_context->registry)
-        g_object_unref(im_context->registry);
-
     G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
@@ -252,63 +316,73 @@ maliit_im_context_class_init(MaliitIMContextClass *klass)
     imclass->get_preedit_string = maliit_im_context_get_preedit_string;
     imclass->set_cursor_location = maliit_im_context_set_cursor_location;
     imclass->set_use_preedit = maliit_im_context_set_preedit_enabled;
+
+    maliit_connection_set_ready_func(maliit_im_context_connection_ready, NULL);
+    maliit_connection_watch_server();
+
+    g_signal_add_emission_hook(g_signal_lookup("delete-surrounding", GTK_TYPE_IM_CONTEXT), 0,
+                               maliit_im_context_delete_surrounding, NULL, NULL);
 }
 
 
-static MaliitContext *
-get_context(MaliitIMContext *context)
+/* The server and context proxies are shared by the whole process, and each
+ * of their signals has a single handler which acts on the focused context,
+ * so a server callback costs the same whatever the number of contexts. */
+static void
+maliit_im_context_connection_ready(MaliitServer *server,
+                                   MaliitContext *context,
+                                   gpointer user_data G_GNUC_UNUSED)
 {
-    GError *error = NULL;
-
-    if (!context->context && maliit_is_running()) {
-        context->context = maliit_get_context_sync(NULL, &error);
-
-        if (context->context) {
-            g_object_ref(context->context);
-            g_signal_connect(context->context, "handle-im-initiated-hide",
-                             G_CALLBACK(maliit_im_context_im_initiated_hide), context);
-            g_signal_connect(context->context, "handle-commit-string",
-                             G_CALLBACK(maliit_im_context_commit_string), context);
-            g_signal_connect(context->context, "handle-update-preedit",
-                             G_CALLBACK(maliit_im_context_update_preedit), context);
-            g_signal_connect(context->context, "handle-key-event",
-                             G_CALLBACK(maliit_im_context_key_event), context);
-            g_signal_connect(context->context, "handle-set-redirect-keys",
-                             G_CALLBACK(maliit_im_context_set_redirect_keys), context);
-            g_signal_connect(context->context, "handle-notify-extended-attribute-changed",
-                             G_CALLBACK(maliit_im_context_notify_extended_attribute_changed), context);
-            g_signal_connect(context->context, "handle-update-input-method-area",
-                             G_CALLBACK(maliit_im_context_update_input_method_area), context);
-        } else {
-            g_warning("Unable to connect to context: %s", error->message);
-            g_clear_error(&error);
-        }
+    gboolean shown;
+
+    /* Also called again after the server restarted, which asks for the
+     * keys anew once the context is activated. */
+    redirect_keys = FALSE;
+
+    g_signal_connect(context, "handle-im-initiated-hide",
+                     G_CALLBACK(maliit_im_context_im_initiated_hide), NULL);
+    g_signal_connect(context, "handle-commit-string",
+                     G_CALLBACK(maliit_im_context_commit_string), NULL);
+    g_signal_connect(context, "handle-update-preedit",
+                     G_CALLBACK(maliit_im_context_update_preedit), NULL);
+    g_signal_connect(context, "handle-key-event",
+                     G_CALLBACK(maliit_im_context_key_event), NULL);
+    g_signal_connect(context, "handle-set-redirect-keys",
+                     G_CALLBACK(maliit_im_context_set_redirect_keys), NULL);
+    g_signal_connect(context, "handle-notify-extended-attribute-changed",
+                     G_CALLBACK(maliit_im_context_notify_extended_attribute_changed), NULL);
+    g_signal_connect(context, "handle-update-input-method-area",
+                     G_CALLBACK(maliit_im_context_update_input_method_area), NULL);
+
+    g_signal_connect(server, "invoke-action", G_CALLBACK(maliit_im_context_invoke_action), NULL);
+
+    /* Back after the server was away: it knows nothing of the context
+     * focused now, whose state is built afresh. */
+    if (maliit_connection_take_resync(&shown) && focused_im_context) {
+        DBG(FOCUS, "replaying im_context = %p", focused_im_context);
+        maliit_connection_activate_context();
+        maliit_im_context_send_widget_info(focused_im_context, TRUE);
+        if (shown)
+            maliit_connection_show_input_method();
     }
-
-    return context->context;
 }
 
 
-static MaliitServer *
-get_server(MaliitIMContext *context)
+/* An emission hook rather than a handler on every context: it costs
+ * nothing per context, and runs ahead of the widget's own handler, which
+ * does the deletion and stops the emission. */
+static gboolean
+maliit_im_context_delete_surrounding(GSignalInvocationHint *hint G_GNUC_UNUSED,
+                                     guint n_param_values G_GNUC_UNUSED,
+                                     const GValue *param_values,
+                                     gpointer user_data G_GNUC_UNUSED)
 {
-    GError *error = NULL;
-
-    if (!context->server && maliit_is_running()) {
-        get_context(context);
+    GObject *context = g_value_get_object(&param_values[0]);
 
-        context->server = maliit_get_server_sync(NULL, &error);
+    if (MALIIT_IS_IM_CONTEXT(context))
+        maliit_im_context_invalidate_surrounding_text(MALIIT_IM_CONTEXT(context));
 
-        if (context->server) {
-            g_object_ref(context->server);
-            g_signal_connect(context->server, "invoke-action", G_CALLBACK(maliit_im_context_invoke_action), context);
-        } else {
-            g_warning("Unable to connect to server: %s", error->message);
-            g_clear_error(&error);
-        }
-    }
-
-    return context->server;
+    return TRUE;
 }
 
 
@@ -328,11 +402,19 @@ maliit_im_context_init(MaliitIMContext *self)
 
     self->focus_state = FALSE;
 
-    if (maliit_is_running()) {
-        get_context(self);
+    /* Nothing here may block: the connection to the server is set up
+     * asynchronously, from maliit_connection_prewarm() or on first use.
+     * Nothing is allocated either: see maliit_im_context_get_state(). */
+}
 
-        self->registry = maliit_attribute_extension_registry_get_instance();
-    }
+
+static gboolean
+focus_out_timeout(gpointer user_data G_GNUC_UNUSED)
+{
+    focus_out_timeout_id = 0;
+    maliit_im_context_flush_focus_out();
+
+    return G_SOURCE_REMOVE;
 }
 
 
@@ -341,26 +423,34 @@ maliit_im_context_focus_in(GtkIMContext *context)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
 
-    if (!maliit_is_running())
-        return;
-
-    DBG("im_context = %p", im_context);
+    DBG(FOCUS, "im_context = %p", im_context);
 
     if (focused_im_context && focused_im_context != im_context)
         maliit_im_context_focus_out(GTK_IM_CONTEXT(focused_im_context));
     focused_im_context = im_context;
 
     im_context->focus_state = TRUE;
-    maliit_im_context_update_widget_info(im_context);
 
-    maliit_server_call_activate_context(get_server(im_context), NULL, NULL, NULL);
-    maliit_server_call_update_widget_information(get_server(im_context),
-                                                 im_context->widget_state,
-                                                 TRUE,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL);
-    maliit_server_call_show_input_method(get_server(im_context), NULL, NULL, NULL);
+    /* Kept track of all the same, for the server to be told about this
+     * context when it is back. A pending focus-out has nobody to go to. */
+    if (!maliit_connection_is_running()) {
+        maliit_im_context_cancel_focus_out();
+        maliit_connection_set_resync(TRUE);
+        return;
+    }
+
+    maliit_metrics_begin(MALIIT_HISTOGRAM_FOCUS_TO_SHOW);
+
+    /* Moving from one context to the next: the server drops the preedit
+     * of the previous one, if it has one (it was committed here already),
+     * and is then only told about the new context. Sent back to back;
+     * none of them waits for a reply. */
+    if (maliit_im_context_cancel_focus_out())
+        maliit_connection_reset();
+
+    maliit_connection_activate_context();
+    maliit_im_context_send_widget_info(im_context, TRUE);
+    maliit_connection_show_input_method();
 
     // TODO: anything else than call "activateContext" and "showInputMethod" ?
 }
@@ -371,39 +461,134 @@ maliit_im_context_focus_out(GtkIMContext *context)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
 
-    if (!maliit_is_running())
-        return;
+    DBG(FOCUS, "im_context = %p", im_context);
 
-    DBG("im_context = %p", im_context);
+    if (!maliit_connection_is_running()) {
+        if (focused_im_context == im_context) {
+            maliit_im_context_commit_preedit(im_context);
+            focused_im_context = NULL;
+            focused_widget = NULL;
+            maliit_connection_set_resync(FALSE);
+        }
+        im_context->focus_state = FALSE;
+        maliit_im_context_cancel_focus_out();
+        maliit_im_context_queue_release_state(im_context);
+        return;
+    }
 
-    maliit_im_context_reset(context);
+    /* As a reset would, but the server is told in
+     * maliit_im_context_flush_focus_out(), or only what it needs to be
+     * when the focus comes back first. */
+    if (focused_im_context == im_context)
+        maliit_im_context_commit_preedit(im_context);
 
     im_context->focus_state = FALSE;
     focused_im_context = NULL;
     focused_widget = NULL;
+    maliit_im_context_cancel_widget_info(im_context);
 
-    maliit_im_context_update_widget_info(im_context);
+    /* Only one focus-out can be pending: focus_in() takes it back, and no
+     * context is focused until then. */
+    maliit_im_context_flush_focus_out();
+    unfocused_im_context = im_context;
+
+    if (focus_out_delay() == 0) {
+        maliit_im_context_flush_focus_out();
+        return;
+    }
 
-    maliit_server_call_update_widget_information(get_server(im_context),
-                                                 im_context->widget_state,
-                                                 TRUE,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL);
-    maliit_server_call_hide_input_method(get_server(im_context), NULL, NULL, NULL);
+    focus_out_timeout_id = g_timeout_add(focus_out_delay(), focus_out_timeout, NULL);
 
     // TODO: anything else than call "hideInputMethod" ?
 }
 
 
+static guint
+focus_out_delay(void)
+{
+    static gint delay = -1;
+
+    if (delay == -1) {
+        const char *value = g_getenv("MALIIT_FOCUS_OUT_DELAY");
+        long ms = value ? strtol(value, NULL, 10) : -1;
+
+        delay = ms >= 0 && ms <= G_MAXINT ? (gint) ms : DEFAULT_FOCUS_OUT_DELAY_MS;
+        DBG(FOCUS, "focus-out delay: %d ms", delay);
+    }
+
+    return delay;
+}
+
+
+/* Tell the server the focus left: reset, the context's widget state, now
+ * with focusState false, then hideInputMethod. */
+static void
+maliit_im_context_flush_focus_out(void)
+{
+    MaliitIMContext *im_context = unfocused_im_context;
+
+    if (!im_context)
+        return;
+
+    unfocused_im_context = NULL;
+    if (focus_out_timeout_id) {
+        g_source_remove(focus_out_timeout_id);
+        focus_out_timeout_id = 0;
+    }
+
+    DBG(FOCUS, "im_context = %p", im_context);
+
+    maliit_connection_reset();
+    maliit_im_context_send_widget_info(im_context, TRUE);
+    maliit_connection_hide_input_method();
+
+    maliit_im_context_queue_release_state(im_context);
+}
+
+
+/* A focus-in within the delay: the server is never told the focus left,
+ * and the focus-in's own update replaces the widget state it holds.
+ * Returns whether a focus-out was pending. */
+static gboolean
+maliit_im_context_cancel_focus_out(void)
+{
+    if (!unfocused_im_context)
+        return FALSE;
+
+    DBG(FOCUS, "im_context = %p", unfocused_im_context);
+    MALIIT_COUNT(MALIIT_COUNTER_FOCUS_OUT_DEBOUNCED);
+
+    if (unfocused_im_context != focused_im_context)
+        maliit_im_context_queue_release_state(unfocused_im_context);
+
+    unfocused_im_context = NULL;
+    if (focus_out_timeout_id) {
+        g_source_remove(focus_out_timeout_id);
+        focus_out_timeout_id = 0;
+    }
+
+    return TRUE;
+}
+
+
 static gboolean
 maliit_im_context_filter_key_event(GtkIMContext *context, GdkEventKey *event)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
     int qevent_type = 0, qt_keycode = 0, qt_modifier = 0;
     gchar *text = "";
+    gboolean auto_repeat;
+
+    /* Key events the module put back itself are not part of what was
+     * typed: they belong to the sequence of the key the server answered. */
+    if (!(event->state & IM_FORWARD_MASK)) {
+        MALIIT_TRACE_BEGIN(MALIIT_TRACE_FILTER_KEY_EVENT);
+        MALIIT_KEY_RECORD(event);
+    } else {
+        MALIIT_TRACE(MALIIT_TRACE_FILTER_KEY_EVENT);
+    }
 
-    if (!maliit_is_running()) {
+    if (!maliit_connection_is_running()) {
         gchar string[10];
         gunichar c = gdk_keyval_to_unicode(event->keyval);
 
@@ -429,13 +614,16 @@ maliit_im_context_filter_key_event(GtkIMContext *context, GdkEventKey *event)
 
     focused_widget = gtk_get_event_widget((GdkEvent *)event);
 
-    DBG("event type=0x%x, state=0x%x, keyval=0x%x, keycode=0x%x, group=%d",
+    DBG(KEYS, "event type=0x%x, state=0x%x, keyval=0x%x, keycode=0x%x, group=%d",
         event->type, event->state, event->keyval, event->hardware_keycode, event->group);
 
     if (focused_im_context != im_context)
         maliit_im_context_focus_in(context);
 
-    if ((event->state & IM_FORWARD_MASK) || !redirect_keys) {
+    /* The server has to see the state the key applies to. */
+    maliit_im_context_flush_widget_info(im_context);
+
+    if ((event->state & IM_FORWARD_MASK) || !redirect_keys || !maliit_connection_get_server()) {
         GtkIMContext *slave = maliit_im_context_get_slave_imcontext();
         return gtk_im_context_filter_keypress(slave, event);
     }
@@ -443,19 +631,26 @@ maliit_im_context_filter_key_event(GtkIMContext *context, GdkEventKey *event)
     if (!gdk_key_event_to_qt(event, &qevent_type, &qt_keycode, &qt_modifier))
         return FALSE;
 
-    maliit_server_call_process_key_event(get_server(im_context),
-                                         qevent_type,
-                                         qt_keycode,
-                                         qt_modifier,
-                                         text,
-                                         0,
-                                         1,
-                                         event->hardware_keycode,
-                                         event->state,
-                                         event->time,
-                                         NULL,
-                                         NULL,
-                                         NULL);
+    /* GDK asks for detectable auto-repeat, so a repeated key sends presses
+     * only: a press of the key that is already down is a repeat. */
+    auto_repeat = event->type == GDK_KEY_PRESS && event->hardware_keycode == pressed_keycode;
+    if (event->type == GDK_KEY_PRESS)
+        pressed_keycode = event->hardware_keycode;
+    else if (event->hardware_keycode == pressed_keycode)
+        pressed_keycode = 0;
+
+    if (event->type == GDK_KEY_PRESS)
+        maliit_metrics_sample(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
+
+    maliit_connection_process_key_event(qevent_type,
+                                        qt_keycode,
+                                        qt_modifier,
+                                        text,
+                                        auto_repeat,
+                                        1,
+                                        event->hardware_keycode,
+                                        event->state,
+                                        event->time);
 
     return TRUE;
 }
@@ -466,35 +661,40 @@ maliit_im_context_reset(GtkIMContext *context)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
 
-    if (!maliit_is_running())
+    if (!maliit_connection_is_running())
         return;
 
-    DBG("im_context = %p", im_context);
+    DBG(PREEDIT, "im_context = %p", im_context);
 
     if (im_context != focused_im_context) {
         return;
     }
 
-    /* Commit preedit if it is not empty */
-    if (focused_im_context && focused_im_context->preedit_str && focused_im_context->preedit_str[0]) {
-        char *commit_string = focused_im_context->preedit_str;
-        focused_im_context->preedit_str = g_strdup("");
-        focused_im_context->preedit_cursor_pos = 0;
-        g_signal_emit_by_name(focused_im_context, "preedit-changed");
-        g_signal_emit_by_name(focused_im_context, "commit", commit_string);
-        g_free(commit_string);
-    }
+    maliit_im_context_commit_preedit(im_context);
 
     /* Update surrounding text state */
-    maliit_im_context_update_widget_info(im_context);
-    maliit_server_call_update_widget_information(get_server(im_context),
-                                                 im_context->widget_state,
-                                                 FALSE,
-                                                 NULL,
-                                                 NULL,
-                                                 NULL);
-
-    maliit_server_call_reset(get_server(im_context), NULL, NULL, NULL);
+    maliit_im_context_queue_widget_info(im_context);
+
+    maliit_connection_reset();
+}
+
+
+/* Commit preedit if it is not empty. Returns whether there was one. */
+static gboolean
+maliit_im_context_commit_preedit(MaliitIMContext *im_context)
+{
+    char *commit_string = im_context->preedit_str;
+
+    if (!commit_string || !commit_string[0])
+        return FALSE;
+
+    im_context->preedit_str = NULL;
+    maliit_im_context_clear_preedit(im_context);
+    g_signal_emit_by_name(im_context, "preedit-changed");
+    g_signal_emit_by_name(im_context, "commit", commit_string);
+    g_free(commit_string);
+
+    return TRUE;
 }
 
 
@@ -503,7 +703,7 @@ maliit_im_context_get_preedit_string(GtkIMContext *context, gchar **str, PangoAt
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
 
-    if (!maliit_is_running()) {
+    if (!maliit_connection_is_running()) {
         if (str)
             *str = g_strdup("");
 
@@ -516,7 +716,7 @@ maliit_im_context_get_preedit_string(GtkIMContext *context, gchar **str, PangoAt
         return;
     }
 
-    DBG("im_context = %p", im_context);
+    DBG(PREEDIT, "im_context = %p", im_context);
 
     if (str) {
         if (im_context->preedit_str)
@@ -545,7 +745,7 @@ maliit_im_context_set_preedit_enabled(GtkIMContext *context, gboolean enabled)
     UNUSED(context);
     UNUSED(enabled);
 
-    if (!maliit_is_running())
+    if (!maliit_connection_is_running())
         return;
 
     // TODO: Seems QT/MEEGO don't need it, it will always showing preedit.
@@ -558,10 +758,10 @@ maliit_im_context_set_client_window(GtkIMContext *context, GdkWindow *window)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
 
-    if (!maliit_is_running())
+    if (!maliit_connection_is_running())
         return;
 
-    STEP();
+    STEP(FOCUS);
 
     if (im_context->client_window)
         g_object_unref(im_context->client_window);
@@ -579,10 +779,10 @@ static void
 maliit_im_context_set_cursor_location(GtkIMContext *context, GdkRectangle *area)
 {
     MaliitIMContext *im_context = MALIIT_IM_CONTEXT(context);
-    //DBG("im_context = %p, x=%d, y=%d, w=%d, h=%d", im_context,
+    //DBG(WIDGET_INFO, "im_context = %p, x=%d, y=%d, w=%d, h=%d", im_context,
     //  area->x, area->y, area->width, area->height);
 
-    if (!maliit_is_running())
+    if (!maliit_connection_is_running())
         return;
 
     im_context->cursor_location = *area;
@@ -593,13 +793,7 @@ maliit_im_context_set_cursor_location(GtkIMContext *context, GdkRectangle *area)
 
     if (im_context->focus_state) {
         /* Update surrounding text state */
-        maliit_im_context_update_widget_info(im_context);
-        maliit_server_call_update_widget_information(get_server(im_context),
-                                                     im_context->widget_state,
-                                                     FALSE,
-                                                     NULL,
-                                                     NULL,
-                                                     NULL);
+        maliit_im_context_queue_widget_info(im_context);
     }
 }
 
@@ -607,6 +801,7 @@ maliit_im_context_set_cursor_location(GtkIMContext *context, GdkRectangle *area)
 void
 maliit_im_context_update_widget_info(MaliitIMContext *im_context)
 {
+    MaliitIMContextState *state = maliit_im_context_get_state(im_context);
     GVariantDict dict;
 
     /* Clear table */
@@ -654,28 +849,360 @@ maliit_im_context_update_widget_info(MaliitIMContext *im_context)
             }
         }
 
-        /* Surrounding text */
+        /* Surrounding text, cut to a window around the cursor. The cursor
+         * position is in characters within the window, and the offset
+         * tells where the window starts in the whole text. */
         GtkIMContext *context = GTK_IM_CONTEXT(im_context);
+        MaliitSurroundingTextCache *cache = &state->surrounding_text_cache;
         gchar *surrounding_text;
         gint cursor_index;
         if (gtk_im_context_get_surrounding(context, &surrounding_text, &cursor_index))
         {
-            g_variant_dict_insert(&dict, WIDGET_INFO_SURROUNDING_TEXT, "s", surrounding_text);
-            g_variant_dict_insert(&dict, WIDGET_INFO_CURSOR_POSITION, "i", cursor_index);
+            if (maliit_surrounding_text_cache_update(cache, surrounding_text, cursor_index,
+                                                     maliit_surrounding_text_window_size())) {
+                g_variant_dict_insert_value(&dict, WIDGET_INFO_SURROUNDING_TEXT, cache->text);
+                g_variant_dict_insert_value(&dict, WIDGET_INFO_CURSOR_POSITION, cache->cursor);
+                g_variant_dict_insert_value(&dict, WIDGET_INFO_SURROUNDING_TEXT_OFFSET, cache->offset);
+            }
+
+            g_free(surrounding_text);
+        }
+    }
+
+    if (state->widget_state)
+        g_variant_unref(state->widget_state);
+
+    state->widget_state = g_variant_ref_sink(g_variant_dict_end(&dict));
+}
+
+
+static MaliitIMContextState *
+maliit_im_context_get_state(MaliitIMContext *im_context)
+{
+    MaliitIMContextState *state = im_context->state;
+
+    if (state) {
+        if (state->release_id) {
+            g_source_remove(state->release_id);
+            state->release_id = 0;
         }
+        return state;
+    }
+
+    if (state_pool_length > 0)
+        state = state_pool[--state_pool_length];
+    else
+        state = g_slice_new0(MaliitIMContextState);
+
+    DBG(FOCUS, "im_context = %p state = %p", im_context, state);
+
+    im_context->state = state;
+    return state;
+}
+
+
+static gboolean
+release_state_timeout(gpointer user_data)
+{
+    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
+
+    im_context->state->release_id = 0;
+    maliit_im_context_release_state(im_context);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+static void
+maliit_im_context_queue_release_state(MaliitIMContext *im_context)
+{
+    MaliitIMContextState *state = im_context->state;
+
+    if (state && !state->release_id)
+        state->release_id = g_timeout_add_seconds(STATE_RELEASE_DELAY_S,
+                                                  release_state_timeout, im_context);
+}
+
+
+/* Drop what the state refers to, and keep the state itself for the next
+ * context to be focused. */
+static void
+maliit_im_context_release_state(MaliitIMContext *im_context)
+{
+    MaliitIMContextState *state = im_context->state;
+
+    if (!state)
+        return;
+
+    DBG(FOCUS, "im_context = %p state = %p", im_context, state);
+
+    /* An update still waiting for a frame would rebuild the state; it goes
+     * with it, and so do the frame clock handlers unless a preedit-changed
+     * waits as well. */
+    maliit_im_context_cancel_widget_info(im_context);
+    im_context->state = NULL;
+
+    if (state->release_id)
+        g_source_remove(state->release_id);
+    if (state->widget_state)
+        g_variant_unref(state->widget_state);
+    maliit_surrounding_text_cache_invalidate(&state->surrounding_text_cache);
+
+    if (state_pool_length < STATE_POOL_SIZE) {
+        memset(state, 0, sizeof(*state));
+        state_pool[state_pool_length++] = state;
+    } else {
+        g_slice_free(MaliitIMContextState, state);
     }
+}
+
+
+static void
+maliit_im_context_invalidate_surrounding_text(MaliitIMContext *im_context)
+{
+    if (im_context->state)
+        maliit_surrounding_text_cache_invalidate(&im_context->state->surrounding_text_cache);
+}
+
 
-    im_context->widget_state = g_variant_ref_sink(g_variant_dict_end(&dict));
+/* Rebuild the widget state and send it now, dropping any scheduled update. */
+static void
+maliit_im_context_send_widget_info(MaliitIMContext *im_context, gboolean focus_changed)
+{
+    maliit_im_context_cancel_widget_info(im_context);
+
+    maliit_im_context_update_widget_info(im_context);
+    maliit_connection_update_widget_information(im_context->state->widget_state, focus_changed);
+}
+
+
+static void
+maliit_im_context_cancel_widget_info(MaliitIMContext *im_context)
+{
+    im_context->widget_info_dirty = FALSE;
+
+    if (im_context->widget_info_timeout_id) {
+        g_source_remove(im_context->widget_info_timeout_id);
+        im_context->widget_info_timeout_id = 0;
+    }
+
+#if GTK_MAJOR_VERSION == 3
+    release_frame_clock(im_context);
+#endif /* GTK_MAJOR_VERSION */
+}
+
+
+/* Send the update scheduled by maliit_im_context_queue_widget_info() right
+ * away, so that it reaches the server ahead of a key event or focus change. */
+static void
+maliit_im_context_flush_widget_info(MaliitIMContext *im_context)
+{
+    if (!im_context->widget_info_dirty)
+        return;
+
+    if (im_context->focus_state)
+        maliit_im_context_send_widget_info(im_context, FALSE);
+    else
+        maliit_im_context_cancel_widget_info(im_context);
+}
+
+
+static gboolean
+widget_info_timeout(gpointer user_data)
+{
+    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
+
+    im_context->widget_info_timeout_id = 0;
+    maliit_im_context_flush_widget_info(im_context);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+#if GTK_MAJOR_VERSION == 3
+static void
+widget_info_after_paint(GdkFrameClock *frame_clock G_GNUC_UNUSED, gpointer user_data)
+{
+    maliit_im_context_flush_widget_info(MALIIT_IM_CONTEXT(user_data));
+}
+
+
+static void
+preedit_changed_update(GdkFrameClock *frame_clock G_GNUC_UNUSED, gpointer user_data)
+{
+    maliit_im_context_flush_preedit_changed(MALIIT_IM_CONTEXT(user_data));
+}
+
+
+/* Disconnect from the frame clock once nothing waits for a frame. */
+static void
+release_frame_clock(MaliitIMContext *im_context)
+{
+    if (!im_context->frame_clock || im_context->widget_info_dirty || im_context->preedit_dirty)
+        return;
+
+    g_signal_handler_disconnect(im_context->frame_clock, im_context->after_paint_id);
+    g_signal_handler_disconnect(im_context->frame_clock, im_context->update_id);
+    g_clear_object(&im_context->frame_clock);
+}
+
+
+/* Have the phase run on the next frame of the client window. The
+ * handlers are only connected while something waits for a frame, so that
+ * the contexts of a window cost its frame clock nothing once flushed,
+ * however many of them were focused; what waits already is flushed from
+ * the clock it waits on. Returns FALSE without a frame clock to use. */
+static gboolean
+request_frame_clock_phase(MaliitIMContext *im_context, GdkFrameClockPhase phase)
+{
+    GdkFrameClock *frame_clock = im_context->frame_clock;
+
+    if (!frame_clock) {
+        if (!im_context->client_window || !gdk_window_is_viewable(im_context->client_window))
+            return FALSE;
+
+        frame_clock = gdk_window_get_frame_clock(im_context->client_window);
+        if (!frame_clock)
+            return FALSE;
+
+        im_context->frame_clock = g_object_ref(frame_clock);
+        im_context->after_paint_id = g_signal_connect(frame_clock, "after-paint",
+                                                      G_CALLBACK(widget_info_after_paint),
+                                                      im_context);
+        im_context->update_id = g_signal_connect(frame_clock, "update",
+                                                 G_CALLBACK(preedit_changed_update),
+                                                 im_context);
+    }
+
+    gdk_frame_clock_request_phase(frame_clock, phase);
+    return TRUE;
+}
+#endif /* GTK_MAJOR_VERSION */
+
+
+/* Mark the widget state out of date and have it sent at most once per
+ * frame: GTK calls set_cursor_location and reset many times per frame
+ * while the user types or scrolls. GTK 3 flushes after the next frame is
+ * painted, GTK 2 (or a window without a frame clock) from a timeout of
+ * about one frame. */
+static void
+maliit_im_context_queue_widget_info(MaliitIMContext *im_context)
+{
+    if (im_context->widget_info_dirty)
+        return;
+
+    im_context->widget_info_dirty = TRUE;
+
+#if GTK_MAJOR_VERSION == 3
+    if (request_frame_clock_phase(im_context, GDK_FRAME_CLOCK_PHASE_AFTER_PAINT))
+        return;
+#endif /* GTK_MAJOR_VERSION */
+
+    im_context->widget_info_timeout_id = g_timeout_add(WIDGET_INFO_FLUSH_INTERVAL_MS,
+                                                       widget_info_timeout,
+                                                       im_context);
+}
+
+
+static void
+maliit_im_context_cancel_preedit_changed(MaliitIMContext *im_context)
+{
+    im_context->preedit_dirty = FALSE;
+
+    if (im_context->preedit_idle_id) {
+        g_source_remove(im_context->preedit_idle_id);
+        im_context->preedit_idle_id = 0;
+    }
+
+#if GTK_MAJOR_VERSION == 3
+    release_frame_clock(im_context);
+#endif /* GTK_MAJOR_VERSION */
+}
+
+
+/* Emit the preedit-changed scheduled by
+ * maliit_im_context_queue_preedit_changed() right away, ahead of a commit
+ * or key event that applies to it. */
+static void
+maliit_im_context_flush_preedit_changed(MaliitIMContext *im_context)
+{
+    if (!im_context->preedit_dirty)
+        return;
+
+    maliit_im_context_cancel_preedit_changed(im_context);
+    MALIIT_TRACE(MALIIT_TRACE_EMIT_PREEDIT_CHANGED);
+    g_signal_emit_by_name(im_context, "preedit-changed");
+}
+
+
+static gboolean
+preedit_changed_idle(gpointer user_data)
+{
+    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
+
+    im_context->preedit_idle_id = 0;
+    maliit_im_context_flush_preedit_changed(im_context);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+/* Each preedit-changed makes the widget relayout, and handwriting or
+ * voice input can update the preedit many times per frame. The preedit
+ * itself is stored right away, so get_preedit_string always returns the
+ * latest one, but the signal is emitted once per frame: in the update
+ * phase on GTK 3, before the frame is laid out, or just ahead of the
+ * redraw otherwise. */
+static void
+maliit_im_context_queue_preedit_changed(MaliitIMContext *im_context)
+{
+    if (im_context->preedit_dirty) {
+        MALIIT_COUNT(MALIIT_COUNTER_PREEDIT_COALESCED);
+        return;
+    }
+
+    im_context->preedit_dirty = TRUE;
+
+#if GTK_MAJOR_VERSION == 3
+    if (request_frame_clock_phase(im_context, GDK_FRAME_CLOCK_PHASE_UPDATE))
+        return;
+#endif /* GTK_MAJOR_VERSION */
+
+    im_context->preedit_idle_id = g_idle_add_full(PREEDIT_CHANGED_PRIORITY,
+                                                  preedit_changed_idle,
+                                                  im_context, NULL);
+}
+
+
+/* Drop the preedit, once it is committed. The caller emits
+ * preedit-changed, which makes any scheduled emission redundant. */
+static void
+maliit_im_context_clear_preedit(MaliitIMContext *im_context)
+{
+    g_free(im_context->preedit_str);
+    im_context->preedit_str = g_strdup("");
+    im_context->preedit_cursor_pos = 0;
+
+    if (im_context->preedit_attrs) {
+        pango_attr_list_unref(im_context->preedit_attrs);
+        im_context->preedit_attrs = NULL;
+    }
+    g_clear_pointer(&im_context->preedit_format, g_variant_unref);
+
+    maliit_im_context_invalidate_surrounding_text(im_context);
+    maliit_im_context_cancel_preedit_changed(im_context);
 }
 
 // Call back functions for dbus obj
 gboolean
 maliit_im_context_im_initiated_hide(MaliitContext *obj,
                                   GDBusMethodInvocation *invocation,
-                                  gpointer user_data)
+                                  gpointer user_data G_GNUC_UNUSED)
 {
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
-    if (im_context != focused_im_context)
+    MALIIT_COUNT(MALIIT_COUNTER_IM_INITIATED_HIDE);
+    maliit_connection_input_method_hidden();
+    MaliitIMContext *im_context = focused_im_context;
+    if (!im_context)
         return FALSE;
 
     if (focused_im_context && focused_im_context->client_window) {
@@ -706,30 +1233,27 @@ maliit_im_context_commit_string(MaliitContext *obj,
                               int replacement_start G_GNUC_UNUSED,
                               int replacement_length G_GNUC_UNUSED,
                               int cursor_pos G_GNUC_UNUSED,
-                              gpointer user_data)
+                              gpointer user_data G_GNUC_UNUSED)
 {
-    DBG("string is:%s", string);
+    DBG(PREEDIT, "string is:%s", string);
+    MALIIT_TRACE(MALIIT_TRACE_COMMIT_STRING);
+    MALIIT_COUNT(MALIIT_COUNTER_COMMIT_STRING);
+    maliit_connection_server_preedit_changed(FALSE);
 
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
-    if (im_context != focused_im_context)
+    MaliitIMContext *im_context = focused_im_context;
+    if (!im_context)
         return FALSE;
 
     if (focused_im_context) {
-        g_free(focused_im_context->preedit_str);
-        focused_im_context->preedit_str = g_strdup("");
-        focused_im_context->preedit_cursor_pos = 0;
+        maliit_im_context_clear_preedit(focused_im_context);
         g_signal_emit_by_name(focused_im_context, "preedit-changed");
+        MALIIT_TRACE(MALIIT_TRACE_EMIT_COMMIT);
+        maliit_metrics_end(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
         g_signal_emit_by_name(focused_im_context, "commit", string);
         maliit_context_complete_commit_string(obj, invocation);
 
         /* Update surrounding text state */
-        maliit_im_context_update_widget_info(focused_im_context);
-        maliit_server_call_update_widget_information(get_server(focused_im_context),
-                                                     focused_im_context->widget_state,
-                                                     FALSE,
-                                                     NULL,
-                                                     NULL,
-                                                     NULL);
+        maliit_im_context_queue_widget_info(focused_im_context);
 
         return TRUE;
     }
@@ -737,48 +1261,6 @@ maliit_im_context_commit_string(MaliitContext *obj,
     return FALSE;
 }
 
-typedef enum
-{
-    MaliitPreeditDefault,
-    MaliitPreeditNoCandidates,
-    MaliitPreeditKeyPress,
-    MaliitPreeditUnconvertible,
-    MaliitPreeditActive
-} MaliitPreeditFace;
-
-static void
-get_byte_range_from_unicode_offsets (const gchar *string,
-                                     gint         utf8_start,
-                                     gint         utf8_length,
-                                     gint        *byte_start,
-                                     gint        *byte_end)
-{
-    gint start;
-    gint end;
-
-    /* we provide start index and length in utf8 characters, but pango
-     * expects start and end indices in bytes.
-     */
-    if (g_utf8_validate (string, -1, NULL)) {
-        const gchar * const start_pointer = g_utf8_offset_to_pointer (string, utf8_start);
-        const gchar * const end_pointer = g_utf8_offset_to_pointer (string, utf8_start + utf8_length);
-
-        /* pointer arithmetics, there you have it. */
-        start = start_pointer - string;
-        end = end_pointer - string;
-    } else {
-        start = utf8_start;
-        end = utf8_start + utf8_length;
-    }
-
-    if (byte_start) {
-        *byte_start = start;
-    }
-    if (byte_end) {
-        *byte_end = end;
-    }
-}
-
 gboolean
 maliit_im_context_update_preedit(MaliitContext *obj,
                                GDBusMethodInvocation *invocation,
@@ -787,82 +1269,61 @@ maliit_im_context_update_preedit(MaliitContext *obj,
                                gint replaceStart G_GNUC_UNUSED,
                                gint replaceLength G_GNUC_UNUSED,
                                gint cursorPos,
-                               gpointer user_data)
+                               gpointer user_data G_GNUC_UNUSED)
 {
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
-    if (im_context != focused_im_context)
+    MALIIT_TRACE(MALIIT_TRACE_UPDATE_PREEDIT);
+    MALIIT_COUNT(MALIIT_COUNTER_UPDATE_PREEDIT);
+    maliit_connection_server_preedit_changed(string && string[0]);
+
+    MaliitIMContext *im_context = focused_im_context;
+    if (!im_context)
         return FALSE;
 
-    DBG("im_context = %p string = %s cursorPos = %d", im_context, string, cursorPos);
+    DBG(PREEDIT, "im_context = %p string = %s cursorPos = %d", im_context, string, cursorPos);
 
     if (focused_im_context) {
-        guint iter;
         PangoAttrList* attrs;
 
-        g_free(focused_im_context->preedit_str);
-        focused_im_context->preedit_str = g_strdup(string);
         /* If cursorPos is -1 explicitly set it to the end of the preedit */
         if (cursorPos == -1) {
             cursorPos = g_utf8_strlen(string, -1);
         }
-        focused_im_context->preedit_cursor_pos = cursorPos;
 
-        /* attributes */
-        attrs = pango_attr_list_new();
-
-        for (iter = 0; iter < g_variant_n_children(formatListData); ++iter) {
-            gint start;
-            gint length;
-            MaliitPreeditFace preedit_face;
-            gint byte_start;
-            gint byte_end;
-            PangoAttribute* new_attrs[2] = { NULL, NULL };
-            gint attr_iter;
-
-            g_variant_get_child(formatListData, iter, "(iii)", &start, &length, &preedit_face);
-
-            get_byte_range_from_unicode_offsets(string, start, length, &byte_start, &byte_end);
-
-            switch (preedit_face) {
-            case MaliitPreeditNoCandidates:
-                new_attrs[0] = pango_attr_underline_new (PANGO_UNDERLINE_ERROR);
-                new_attrs[1] = pango_attr_underline_color_new (65535, 0, 0);
-                break;
-
-            case MaliitPreeditUnconvertible: {
-                const gint gray = (2 << 15) - 1; /* halfway from 0 to 65535 */
-
-                new_attrs[0] = pango_attr_foreground_new (gray, gray, gray);
-            } break;
-
-            case MaliitPreeditActive:
-                new_attrs[0] = pango_attr_foreground_new(39168, 12800, 52224);
-                new_attrs[1] = pango_attr_weight_new(PANGO_WEIGHT_BOLD);
-                break;
-
-            case MaliitPreeditKeyPress:
-            case MaliitPreeditDefault:
-                new_attrs[0] = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
-                new_attrs[1] = pango_attr_underline_color_new(0, 0, 0);
-                break;
+        /* Same text and formatting: at most the cursor moved, and the
+         * attributes still apply. */
+        if (focused_im_context->preedit_format &&
+            g_strcmp0(focused_im_context->preedit_str, string) == 0 &&
+            g_variant_equal(focused_im_context->preedit_format, formatListData)) {
+            if (focused_im_context->preedit_cursor_pos == cursorPos) {
+                DBG(PREEDIT, "preedit unchanged");
+                MALIIT_COUNT(MALIIT_COUNTER_PREEDIT_DROPPED);
+            } else {
+                focused_im_context->preedit_cursor_pos = cursorPos;
+                maliit_im_context_queue_preedit_changed(focused_im_context);
             }
 
-            for (attr_iter = 0; attr_iter < 2; ++attr_iter) {
-                if (new_attrs[attr_iter]) {
-                    new_attrs[attr_iter]->start_index = byte_start;
-                    new_attrs[attr_iter]->end_index = byte_end;
-
-                    pango_attr_list_insert(attrs, new_attrs[attr_iter]);
-                }
-            }
+            maliit_context_complete_update_preedit(obj, invocation);
+            return TRUE;
         }
 
+        g_free(focused_im_context->preedit_str);
+        focused_im_context->preedit_str = g_strdup(string);
+        maliit_im_context_invalidate_surrounding_text(focused_im_context);
+        focused_im_context->preedit_cursor_pos = cursorPos;
+
+        /* attributes */
+        attrs = maliit_preedit_attrs_build(string, formatListData);
+
         if (focused_im_context->preedit_attrs) {
             pango_attr_list_unref (focused_im_context->preedit_attrs);
         }
         focused_im_context->preedit_attrs = attrs;
 
-        g_signal_emit_by_name(focused_im_context, "preedit-changed");
+        if (focused_im_context->preedit_format)
+            g_variant_unref(focused_im_context->preedit_format);
+        focused_im_context->preedit_format = g_variant_ref(formatListData);
+
+        maliit_im_context_queue_preedit_changed(focused_im_context);
 
         maliit_context_complete_update_preedit(obj, invocation);
         return TRUE;
@@ -879,21 +1340,51 @@ maliit_im_context_key_event(MaliitContext *obj,
                           gint modifiers,
                           const gchar *text,
                           gboolean auto_repeat G_GNUC_UNUSED,
-                          int count G_GNUC_UNUSED,
+                          int count,
                           guchar request_type G_GNUC_UNUSED,
-                          gpointer user_data)
+                          gpointer user_data G_GNUC_UNUSED)
 {
     GdkEventKey *event = NULL;
     GdkWindow *window = NULL;
+    gboolean is_press;
+    gint i;
 
-    STEP();
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
-    if (im_context != focused_im_context)
+    STEP(KEYS);
+    MALIIT_TRACE(MALIIT_TRACE_KEY_EVENT);
+    MALIIT_COUNT(MALIIT_COUNTER_KEY_EVENT);
+
+    MaliitIMContext *im_context = focused_im_context;
+    if (!im_context)
         return FALSE;
 
     if (focused_im_context)
         window = focused_im_context->client_window;
 
+    /* The widget has to see the preedit the key applies to. */
+    maliit_im_context_flush_preedit_changed(im_context);
+
+    /* Auto-repeated presses folded into one processKeyEvent may come back
+     * as one key event, with their count. */
+    count = MAX(count, 1);
+
+    /* A key that only types its text would come back through
+     * filter_keypress to the slave context, which commits it: commit the
+     * text right away instead. Its release then has nothing left to do. */
+    if (qt_key_event_is_text_input(type, modifiers, text, &is_press)) {
+        if (is_press) {
+            DBG(KEYS, "committing key text %s", text);
+            maliit_im_context_invalidate_surrounding_text(im_context);
+            MALIIT_TRACE(MALIIT_TRACE_EMIT_COMMIT);
+            maliit_metrics_end(MALIIT_HISTOGRAM_KEY_TO_COMMIT);
+            for (i = 0; i < count; i++)
+                g_signal_emit_by_name(im_context, "commit", text);
+            maliit_im_context_queue_widget_info(im_context);
+        }
+
+        maliit_context_complete_key_event(obj, invocation);
+        return TRUE;
+    }
+
     event = qt_key_event_to_gdk(type, key, modifiers, text, window);
     if (!event)
         return FALSE;
@@ -901,7 +1392,9 @@ maliit_im_context_key_event(MaliitContext *obj,
     event->send_event = TRUE;
     event->state |= IM_FORWARD_MASK;
 
-    gdk_event_put((GdkEvent *)event);
+    MALIIT_TRACE(MALIIT_TRACE_PUT_KEY_EVENT);
+    for (i = 0; i < count; i++)
+        gdk_event_put((GdkEvent *)event);
     gdk_event_free((GdkEvent *)event);
 
     maliit_context_complete_key_event(obj, invocation);
@@ -924,16 +1417,19 @@ void
 maliit_im_context_invoke_action(MaliitServer *obj G_GNUC_UNUSED,
                               const char *action,
                               const char *sequence G_GNUC_UNUSED,
-                              gpointer user_data)
+                              gpointer user_data G_GNUC_UNUSED)
 {
     GtkWidget* widget = NULL;
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
+    gpointer window_user_data = NULL;
+    MaliitIMContext *im_context = focused_im_context;
 
-    if (im_context != focused_im_context)
+    MALIIT_COUNT(MALIIT_COUNTER_INVOKE_ACTION);
+
+    if (!im_context)
         return;
 
-    gdk_window_get_user_data (im_context->client_window, &user_data);
-    widget = GTK_WIDGET (user_data);
+    gdk_window_get_user_data (im_context->client_window, &window_user_data);
+    widget = GTK_WIDGET (window_user_data);
 
     if (widget) {
         char *alternative = NULL;
@@ -962,7 +1458,8 @@ maliit_im_context_set_redirect_keys(MaliitContext *obj,
                                   gboolean enabled,
                                   gpointer user_data G_GNUC_UNUSED)
 {
-    DBG("enabled = %d", enabled);
+    MALIIT_COUNT(MALIIT_COUNTER_SET_REDIRECT_KEYS);
+    DBG(KEYS, "enabled = %d", enabled);
     redirect_keys = enabled;
     maliit_context_complete_set_redirect_keys(obj, invocation);
     return TRUE;
@@ -976,13 +1473,14 @@ maliit_im_context_notify_extended_attribute_changed (MaliitContext *obj,
                                                    const gchar *target_item,
                                                    const gchar *attribute,
                                                    GVariant *variant_value,
-                                                   gpointer user_data)
+                                                   gpointer user_data G_GNUC_UNUSED)
 {
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
-    if (im_context != focused_im_context)
+    MALIIT_COUNT(MALIIT_COUNTER_NOTIFY_EXTENDED_ATTRIBUTE_CHANGED);
+    MaliitIMContext *im_context = focused_im_context;
+    if (!im_context)
         return FALSE;
 
-    maliit_attribute_extension_registry_update_attribute (focused_im_context->registry,
+    maliit_attribute_extension_registry_update_attribute (maliit_connection_get_registry(),
 							  id,
 							  target,
 							  target_item,
@@ -1000,13 +1498,15 @@ maliit_im_context_update_input_method_area (MaliitContext *obj,
                                           gint y,
                                           gint width,
                                           gint height,
-                                          gpointer user_data)
+                                          gpointer user_data G_GNUC_UNUSED)
 {
-    MaliitIMContext *im_context = MALIIT_IM_CONTEXT(user_data);
+    MaliitIMContext *im_context = focused_im_context;
     GdkRectangle cursor_rect, osk_rect = { x, y, width, height };
     guint clear_area_id;
 
-    if (!im_context->client_window)
+    MALIIT_COUNT(MALIIT_COUNTER_UPDATE_INPUT_METHOD_AREA);
+
+    if (!im_context || !im_context->client_window)
       return FALSE;
 
     if (im_context->keyboard_area.x == x &&
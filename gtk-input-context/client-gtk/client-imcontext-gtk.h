@@ -26,6 +26,8 @@
 #include <maliit-glib/maliitcontext.h>
 #include <maliit-glib/maliitattributeextensionregistry.h>
 
+#include "surrounding-text.h"
+
 G_BEGIN_DECLS
 
 // Be careful not to override the existing flag of GDK
@@ -45,21 +47,38 @@ typedef struct _MaliitIMContextClass MaliitIMContextClass;
 #define MALIIT_IM_CONTEXT_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj), MALIIT_TYPE_IM_CONTEXT, MaliitIMContextClass))
 
 
+/* What a context keeps of what it sent the server, which only matters
+ * while it has the focus: allocated on first use, and handed back to a
+ * pool once the context has been unfocused for a while, so that a context
+ * which is never focused costs nothing beyond its instance. */
+typedef struct {
+    GVariant *widget_state; /* Mapping between string and GVariants with properties of the focused widget */
+    MaliitSurroundingTextCache surrounding_text_cache;
+    guint release_id;
+} MaliitIMContextState;
+
 struct _MaliitIMContext {
     GtkIMContext parent;
 
-    MaliitServer *server;
-    MaliitContext *context;
-    MaliitAttributeExtensionRegistry *registry;
-
     GdkWindow *client_window;
     GdkRectangle cursor_location;
 
     gchar *preedit_str;
     PangoAttrList *preedit_attrs;
     gint preedit_cursor_pos;
-    GVariant *widget_state; /* Mapping between string and GVariants with properties of the focused widget */
+    GVariant *preedit_format; /* Format list the attributes were built from, NULL if not from the server */
+    gboolean preedit_dirty; /* TRUE means preedit-changed is scheduled */
+    guint preedit_idle_id;
     gboolean focus_state; /* TRUE means a widget is focused, FALSE means no widget is focused */
+    MaliitIMContextState *state; /* NULL until the widget state is first built */
+
+    gboolean widget_info_dirty; /* TRUE means widget_state is out of date and an update is scheduled */
+    guint widget_info_timeout_id;
+#if GTK_MAJOR_VERSION == 3
+    GdkFrameClock *frame_clock; /* Paces widget state updates and preedit-changed, while one is pending */
+    gulong after_paint_id;
+    gulong update_id;
+#endif /* GTK_MAJOR_VERSION */
 
     GdkRectangle keyboard_area;
 };
@@ -73,6 +92,10 @@ GType maliit_im_context_get_type(void);
 void maliit_im_context_register_type(GTypeModule *type_module);
 GtkIMContext *maliit_im_context_new(void);
 
+/* Rebuilds state->widget_state from the context, allocating the state if
+ * needed; exported for the benchmarks. */
+void maliit_im_context_update_widget_info(MaliitIMContext *im_context);
+
 G_END_DECLS
 
 #endif //_CLIENT_IMCONTEXT_GTK_H
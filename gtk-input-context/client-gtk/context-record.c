@@ -0,0 +1,148 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "context-record.h"
+#include "debug.h"
+
+gboolean maliit_context_record_enabled = FALSE;
+
+static FILE *record_file = NULL;
+static GMutex record_mutex;
+static GDBusConnection *record_connection = NULL;
+static guint record_filter_id = 0;
+static gchar *record_object_path = NULL;
+static gchar *record_interface = NULL;
+
+
+/* Runs in the GDBus worker thread, on every message of the connection;
+ * keeps the calls to the context, before they are dispatched. It can
+ * still run right after the filter is removed, hence the check of the
+ * connection under the mutex. */
+static GDBusMessage *
+record_message(GDBusConnection *connection,
+               GDBusMessage *message,
+               gboolean incoming,
+               gpointer user_data G_GNUC_UNUSED)
+{
+    GVariant *body, *record;
+    guint32 record_size;
+    gpointer data;
+
+    if (!incoming || g_dbus_message_get_message_type(message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+        return message;
+
+    g_mutex_lock(&record_mutex);
+
+    if (!record_file || connection != record_connection ||
+        g_strcmp0(g_dbus_message_get_path(message), record_object_path) != 0 ||
+        g_strcmp0(g_dbus_message_get_interface(message), record_interface) != 0) {
+        g_mutex_unlock(&record_mutex);
+        return message;
+    }
+
+    body = g_dbus_message_get_body(message);
+    record = g_variant_ref_sink(g_variant_new(MALIIT_CONTEXT_RECORD_TYPE,
+                                              (guint64) g_get_monotonic_time(),
+                                              g_dbus_message_get_member(message),
+                                              body ? body : g_variant_new_tuple(NULL, 0)));
+
+    record_size = g_variant_get_size(record);
+    data = g_malloc(record_size);
+    g_variant_store(record, data);
+
+    if (fwrite(&record_size, sizeof(record_size), 1, record_file) != 1 ||
+        fwrite(data, record_size, 1, record_file) != 1)
+        g_warning("Unable to record a call to the context");
+
+    g_mutex_unlock(&record_mutex);
+
+    g_free(data);
+    g_variant_unref(record);
+
+    return message;
+}
+
+
+void
+maliit_context_record_attach(MaliitContext *context)
+{
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON(context);
+    GDBusConnection *connection = g_dbus_interface_skeleton_get_connection(skeleton);
+
+    if (!maliit_context_record_enabled || !connection || connection == record_connection)
+        return;
+
+    maliit_context_record_detach();
+
+    g_mutex_lock(&record_mutex);
+    record_object_path = g_strdup(g_dbus_interface_skeleton_get_object_path(skeleton));
+    record_interface = g_strdup(g_dbus_interface_skeleton_get_info(skeleton)->name);
+    record_connection = g_object_ref(connection);
+    g_mutex_unlock(&record_mutex);
+
+    record_filter_id = g_dbus_connection_add_filter(connection, record_message, NULL, NULL);
+}
+
+
+void
+maliit_context_record_detach(void)
+{
+    if (!record_connection)
+        return;
+
+    g_dbus_connection_remove_filter(record_connection, record_filter_id);
+    record_filter_id = 0;
+
+    g_mutex_lock(&record_mutex);
+    g_clear_object(&record_connection);
+    g_clear_pointer(&record_object_path, g_free);
+    g_clear_pointer(&record_interface, g_free);
+    g_mutex_unlock(&record_mutex);
+}
+
+
+void
+maliit_context_record_init(const char *path)
+{
+    if (record_file || !path)
+        return;
+
+    record_file = fopen(path, "wb");
+    if (!record_file) {
+        g_warning("Unable to record context calls to %s", path);
+        return;
+    }
+
+    fwrite(MALIIT_CONTEXT_RECORD_MAGIC, 4, 1, record_file);
+
+    maliit_context_record_enabled = TRUE;
+    DBG(MODULE, "recording context calls to %s", path);
+}
+
+
+void
+maliit_context_record_exit(void)
+{
+    g_mutex_lock(&record_mutex);
+    if (record_file) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+    g_mutex_unlock(&record_mutex);
+}
@@ -0,0 +1,50 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _CONTEXT_RECORD_H
+#define _CONTEXT_RECORD_H
+
+#include <gio/gio.h>
+#include <maliit-glib/maliitcontext.h>
+
+G_BEGIN_DECLS
+
+/* A context record file is the magic below followed by one record per
+ * call the server made on the input context: a guint32 size in host byte
+ * order, then that many bytes of a serialized "(tsv)" GVariant holding
+ * the monotonic time of the call in microseconds, the method name and its
+ * parameters as a tuple. bench-replay-context plays them back. Like a key
+ * record, it holds what was typed. */
+#define MALIIT_CONTEXT_RECORD_MAGIC "MCR1"
+#define MALIIT_CONTEXT_RECORD_TYPE "(tsv)"
+
+/* Set by maliit_context_record_init(). */
+extern gboolean maliit_context_record_enabled;
+
+/* Record the calls made on the context from now on, on its connection,
+ * until that connection is lost and maliit_context_record_detach() is
+ * called. A context from the next connection is attached again. */
+void maliit_context_record_attach(MaliitContext *context);
+void maliit_context_record_detach(void);
+
+/* Record the calls the server makes on the input context to the file,
+ * named by MALIIT_CONTEXT_RECORD, until maliit_context_record_exit(). */
+void maliit_context_record_init(const char *path);
+void maliit_context_record_exit(void);
+
+G_END_DECLS
+
+#endif //_CONTEXT_RECORD_H
@@ -2,20 +2,177 @@
 
 #include <string.h>
 
-gboolean
-maliit_is_debug_enabled(void)
-{
-    static gint debug_enabled = -1;
-
-    if (debug_enabled == -1) {
-        const char *enabled_debug_var = g_getenv("MALIIT_DEBUG");
-        if (enabled_debug_var && strlen(enabled_debug_var) > 0
-            && strcmp(enabled_debug_var, "0") != 0) {
-            debug_enabled = 1;
-        } else {
-            debug_enabled = 0;
-        }
+guint maliit_log_categories = 0;
+
+#ifndef MALIIT_DISABLE_LOGGING
+
+/* Messages go through a ring of fixed-size slots. The main thread, which
+ * is where GTK calls the module, is the only writer; the logging thread
+ * the only reader. Each side owns one index and only reads the other's,
+ * so the writer never waits: when the ring is full, messages are dropped
+ * and counted instead. The reader sleeps on log_cond while the ring is
+ * empty; the writer only takes the mutex to wake it, when the reader had
+ * caught up with it. */
+#define LOG_RING_SIZE 512 /* a power of two */
+#define LOG_MESSAGE_SIZE 256
+
+static gchar log_ring[LOG_RING_SIZE][LOG_MESSAGE_SIZE];
+static gint log_write_pos = 0;
+static gint log_read_pos = 0;
+static gint log_dropped = 0;
+static gint log_stopping = 0;
+static GThread *log_thread = NULL;
+static GMutex log_mutex;
+static GCond log_cond;
+
+static const GDebugKey log_keys[] = {
+    { "keys", MALIIT_LOG_KEYS },
+    { "preedit", MALIIT_LOG_PREEDIT },
+    { "focus", MALIIT_LOG_FOCUS },
+    { "dbus", MALIIT_LOG_DBUS },
+    { "widget-info", MALIIT_LOG_WIDGET_INFO },
+    { "module", MALIIT_LOG_MODULE },
+};
+
+
+static void
+log_drain(void)
+{
+    guint read_pos = (guint) g_atomic_int_get(&log_read_pos);
+    guint write_pos = (guint) g_atomic_int_get(&log_write_pos);
+    gint dropped;
+
+    for (; read_pos != write_pos; read_pos++) {
+        g_debug("%s", log_ring[read_pos & (LOG_RING_SIZE - 1)]);
+        g_atomic_int_set(&log_read_pos, (gint) (read_pos + 1));
+    }
+
+    dropped = g_atomic_int_and(&log_dropped, 0);
+    if (dropped)
+        g_debug("%d debug messages dropped", dropped);
+}
+
+
+static gboolean
+log_empty(void)
+{
+    return g_atomic_int_get(&log_read_pos) == g_atomic_int_get(&log_write_pos);
+}
+
+
+static void
+log_wake(void)
+{
+    g_mutex_lock(&log_mutex);
+    g_cond_signal(&log_cond);
+    g_mutex_unlock(&log_mutex);
+}
+
+
+static gpointer
+log_thread_main(gpointer data G_GNUC_UNUSED)
+{
+    gboolean done = FALSE;
+
+    while (!done) {
+        log_drain();
+
+        g_mutex_lock(&log_mutex);
+        while (log_empty() && !g_atomic_int_get(&log_stopping))
+            g_cond_wait(&log_cond, &log_mutex);
+        done = log_empty() && g_atomic_int_get(&log_stopping);
+        g_mutex_unlock(&log_mutex);
+    }
+
+    return NULL;
+}
+
+
+void
+maliit_log_exit(void)
+{
+    if (!log_thread)
+        return;
+
+    g_atomic_int_set(&log_stopping, 1);
+    log_wake();
+    g_thread_join(log_thread);
+}
+
+
+void
+maliit_log_write(const char *format, ...)
+{
+    guint write_pos = (guint) g_atomic_int_get(&log_write_pos);
+    va_list args;
+
+    if (write_pos - (guint) g_atomic_int_get(&log_read_pos) >= LOG_RING_SIZE) {
+        g_atomic_int_inc(&log_dropped);
+        return;
     }
 
-    return debug_enabled == 1;
+    va_start(args, format);
+    g_vsnprintf(log_ring[write_pos & (LOG_RING_SIZE - 1)], LOG_MESSAGE_SIZE, format, args);
+    va_end(args);
+
+    g_atomic_int_set(&log_write_pos, (gint) (write_pos + 1));
+
+    /* The reader may have found the ring empty just before this message
+     * went in. Otherwise it has yet to get to the previous message, and
+     * finds this one before it sleeps. */
+    if ((guint) g_atomic_int_get(&log_read_pos) == write_pos)
+        log_wake();
 }
+
+
+void
+maliit_log_init(void)
+{
+    const char *debug = g_getenv("MALIIT_DEBUG");
+
+    if (maliit_log_categories || !debug || !debug[0] || strcmp(debug, "0") == 0)
+        return;
+
+    /* Any value that names no category, such as "1" or "yes", turns all
+     * of them on, as any value but "0" always did. */
+    maliit_log_categories = g_parse_debug_string(debug, log_keys, G_N_ELEMENTS(log_keys));
+    if (!maliit_log_categories)
+        maliit_log_categories = g_parse_debug_string("all", log_keys, G_N_ELEMENTS(log_keys));
+}
+
+
+void
+maliit_log_start(void)
+{
+    if (log_thread || !maliit_log_categories)
+        return;
+
+    log_thread = g_thread_new("maliit-log", log_thread_main, NULL);
+}
+
+#else /* MALIIT_DISABLE_LOGGING */
+
+void
+maliit_log_write(const char *format G_GNUC_UNUSED, ...)
+{
+}
+
+
+void
+maliit_log_init(void)
+{
+}
+
+
+void
+maliit_log_start(void)
+{
+}
+
+
+void
+maliit_log_exit(void)
+{
+}
+
+#endif /* MALIIT_DISABLE_LOGGING */
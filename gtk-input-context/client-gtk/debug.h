@@ -5,11 +5,44 @@
 
 G_BEGIN_DECLS
 
-gboolean maliit_is_debug_enabled(void);
-
-#define DBG(x, a...) if (maliit_is_debug_enabled()) { g_debug("%s: " x, __FUNCTION__, ##a); }
-
-#define STEP() DBG("")
+typedef enum {
+    MALIIT_LOG_KEYS        = 1 << 0,
+    MALIIT_LOG_PREEDIT     = 1 << 1,
+    MALIIT_LOG_FOCUS       = 1 << 2,
+    MALIIT_LOG_DBUS        = 1 << 3,
+    MALIIT_LOG_WIDGET_INFO = 1 << 4,
+    MALIIT_LOG_MODULE      = 1 << 5
+} MaliitLogCategory;
+
+/* The categories enabled by MALIIT_DEBUG, a list such as
+ * "keys,preedit", or "all" or any other value but "0" for all of them.
+ * Read directly, so that a disabled category costs one branch and its
+ * arguments are never evaluated. */
+extern guint maliit_log_categories;
+
+/* Parse MALIIT_DEBUG. Until this is called nothing is logged, and until
+ * maliit_log_start() messages are only queued. */
+void maliit_log_init(void);
+
+/* Start the logging thread, and stop it once it has passed on every
+ * queued message. */
+void maliit_log_start(void);
+void maliit_log_exit(void);
+
+/* Queue a message for the logging thread, which passes it to g_debug(). */
+void maliit_log_write(const char *format, ...) G_GNUC_PRINTF(1, 2);
+
+#ifdef MALIIT_DISABLE_LOGGING
+/* Still type-checked, but never run and dropped by the compiler. */
+#define DBG(category, x, a...) G_STMT_START { if (0) maliit_log_write("%s: " x, __FUNCTION__, ##a); } G_STMT_END
+#else
+#define DBG(category, x, a...) G_STMT_START {                                   \
+        if (G_UNLIKELY(maliit_log_categories & MALIIT_LOG_##category))          \
+            maliit_log_write("%s: " x, __FUNCTION__, ##a);                       \
+    } G_STMT_END
+#endif
+
+#define STEP(category) DBG(category, "")
 
 #define UNUSED(v) (void)v;
 
@@ -28,6 +28,11 @@
 #include <gtk/gtkimmodule.h>
 
 #include "client-imcontext-gtk.h"
+#include "client-connection.h"
+#include "context-record.h"
+#include "key-record.h"
+#include "metrics.h"
+#include "trace.h"
 #include "debug.h"
 
 static const GtkIMContextInfo maliit_im_info = {
@@ -44,6 +49,38 @@ static const GtkIMContextInfo *info_list[] = {
 };
 
 
+/* The file named by an environment variable the module writes its output
+ * to, or NULL. The variable is unset, as child processes would inherit it
+ * and write to the same file. */
+static gchar *
+take_output_path(const char *name)
+{
+    const char *value = g_getenv(name);
+    gchar *path;
+
+    if (!value || !value[0])
+        return NULL;
+
+    path = g_strdup(value);
+    g_unsetenv(name);
+    return path;
+}
+
+
+/* Registered with atexit(). GTK unloads a module once none of its types
+ * is in use; im_module_init() keeps this one in use, so that it is still
+ * mapped then. */
+static void
+module_atexit(void)
+{
+    maliit_trace_exit();
+    maliit_metrics_exit();
+    maliit_key_record_exit();
+    maliit_context_record_exit();
+    maliit_log_exit();
+}
+
+
 void im_module_init(GTypeModule *type_module);
 void im_module_exit(void);
 void im_module_list(const GtkIMContextInfo ***contexts, int *context_number);
@@ -53,17 +90,37 @@ GtkIMContext *im_module_create(const gchar *context_id);
 void
 im_module_init(GTypeModule *type_module)
 {
-    STEP();
+    gchar *path;
+
+    maliit_log_init();
+    STEP(MODULE);
     g_type_module_use(type_module);
     maliit_im_context_register_type(type_module);
-    STEP();
+    /* These unset the variables they read, which is not safe once the
+     * logging thread may be reading the environment in g_debug(). */
+    path = take_output_path("MALIIT_TRACE");
+    maliit_trace_init(path);
+    g_free(path);
+    path = take_output_path("MALIIT_KEY_RECORD");
+    maliit_key_record_init(path);
+    g_free(path);
+    path = take_output_path("MALIIT_CONTEXT_RECORD");
+    maliit_context_record_init(path);
+    g_free(path);
+    path = take_output_path("MALIIT_METRICS");
+    maliit_metrics_init(path);
+    g_free(path);
+    maliit_log_start();
+    atexit(module_atexit);
+    maliit_connection_prewarm();
+    STEP(MODULE);
 }
 
 
 void
 im_module_exit()
 {
-    STEP();
+    STEP(MODULE);
 }
 
 
@@ -0,0 +1,82 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "key-record.h"
+#include "debug.h"
+
+gboolean maliit_key_record_enabled = FALSE;
+
+static FILE *record_file = NULL;
+
+
+/* Key events come from the main thread only. stdio buffers the records,
+ * so a keystroke costs a copy into the buffer and a write every few
+ * thousand keys. */
+void
+maliit_key_record(const GdkEventKey *event)
+{
+    MaliitKeyRecord record;
+
+    record.time = event->time;
+    record.keyval = event->keyval;
+    record.state = event->state;
+    record.hardware_keycode = event->hardware_keycode;
+    record.release = event->type == GDK_KEY_RELEASE;
+    record.group = event->group;
+
+    if (fwrite(&record, sizeof(record), 1, record_file) != 1) {
+        g_warning("Unable to record key events, stopping");
+        maliit_key_record_enabled = FALSE;
+    }
+}
+
+
+void
+maliit_key_record_init(const char *path)
+{
+    MaliitKeyRecordHeader header;
+
+    if (record_file || !path)
+        return;
+
+    record_file = fopen(path, "wb");
+    if (!record_file) {
+        g_warning("Unable to record key events to %s", path);
+        return;
+    }
+
+    memcpy(header.magic, MALIIT_KEY_RECORD_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(MaliitKeyRecord);
+    fwrite(&header, sizeof(header), 1, record_file);
+
+    maliit_key_record_enabled = TRUE;
+    DBG(MODULE, "recording key events to %s", path);
+}
+
+
+void
+maliit_key_record_exit(void)
+{
+    if (!record_file)
+        return;
+
+    maliit_key_record_enabled = FALSE;
+    fclose(record_file);
+    record_file = NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _KEY_RECORD_H
+#define _KEY_RECORD_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* A key record file is the header below followed by one record per key
+ * event, in host byte order, as bench-replay-keys reads them back. It
+ * holds everything that was typed, passwords included, and is only
+ * written when MALIIT_KEY_RECORD asks for it. */
+#define MALIIT_KEY_RECORD_MAGIC "MKR1"
+
+typedef struct {
+    char magic[4];
+    guint32 record_size;
+} MaliitKeyRecordHeader;
+
+typedef struct {
+    guint32 time;       /* GdkEventKey time, in ms */
+    guint32 keyval;
+    guint32 state;
+    guint16 hardware_keycode;
+    guint8 release;     /* 0 for GDK_KEY_PRESS, 1 for GDK_KEY_RELEASE */
+    guint8 group;
+} MaliitKeyRecord;
+
+/* Set by maliit_key_record_init(). */
+extern gboolean maliit_key_record_enabled;
+
+void maliit_key_record(const GdkEventKey *event);
+
+/* Record the key events filtered by the module to the file, named by
+ * MALIIT_KEY_RECORD, until maliit_key_record_exit(). */
+void maliit_key_record_init(const char *path);
+void maliit_key_record_exit(void);
+
+#define MALIIT_KEY_RECORD(event) G_STMT_START {                         \
+        if (G_UNLIKELY(maliit_key_record_enabled))                      \
+            maliit_key_record(event);                                   \
+    } G_STMT_END
+
+G_END_DECLS
+
+#endif //_KEY_RECORD_H
@@ -0,0 +1,228 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <signal.h>
+#include <stdio.h>
+
+#include <glib-unix.h>
+
+#include "metrics.h"
+#include "debug.h"
+
+/* Log-linear buckets, as in HDR histograms: values below 8us get a bucket
+ * each, then every power of two is split into 8 buckets, which bounds the
+ * error to 12.5%. The last bucket starts at 2^40us, about 12 days. */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_EXPONENT 40
+#define N_BUCKETS ((MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS)
+
+typedef struct {
+    guint32 buckets[N_BUCKETS];
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+    gint64 start; /* of the interval under way, 0 if none */
+} Histogram;
+
+guint64 maliit_counters[MALIIT_N_COUNTERS];
+
+static Histogram histograms[MALIIT_N_HISTOGRAMS];
+static gchar *metrics_path = NULL;
+
+static const char * const counter_names[MALIIT_N_COUNTERS] = {
+    "call.activate_context",
+    "call.update_widget_information",
+    "call.reset",
+    "call.show_input_method",
+    "call.hide_input_method",
+    "call.process_key_event",
+    "callback.im_initiated_hide",
+    "callback.commit_string",
+    "callback.update_preedit",
+    "callback.key_event",
+    "callback.set_redirect_keys",
+    "callback.notify_extended_attribute_changed",
+    "callback.update_input_method_area",
+    "callback.invoke_action",
+    "surrounding_text.bytes",
+    "widget_information.skipped",
+    "key_events.folded",
+    "preedit.dropped",
+    "preedit.coalesced",
+    "focus_out.debounced",
+    "show_input_method.skipped",
+    "reset.skipped",
+};
+
+static const char * const histogram_names[MALIIT_N_HISTOGRAMS] = {
+    "key_to_commit_us",
+    "focus_to_show_us",
+};
+
+
+static guint
+bucket_index(guint64 value)
+{
+    gint exponent;
+
+    if (value < SUB_BUCKETS)
+        return value;
+
+    exponent = g_bit_nth_msf(value >> 32, -1);
+    exponent = exponent >= 0 ? exponent + 32 : g_bit_nth_msf((gulong) (value & 0xffffffff), -1);
+    if (exponent > MAX_EXPONENT)
+        return N_BUCKETS - 1;
+
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+           + ((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+
+/* Lowest value that falls into the bucket. */
+static guint64
+bucket_value(guint index)
+{
+    guint exponent;
+
+    if (index < SUB_BUCKETS)
+        return index;
+
+    exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    return (guint64) (SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS);
+}
+
+
+void
+maliit_metrics_begin(MaliitHistogram histogram)
+{
+    histograms[histogram].start = g_get_monotonic_time();
+}
+
+
+void
+maliit_metrics_sample(MaliitHistogram histogram)
+{
+    if (!histograms[histogram].start)
+        histograms[histogram].start = g_get_monotonic_time();
+}
+
+
+void
+maliit_metrics_cancel(MaliitHistogram histogram)
+{
+    histograms[histogram].start = 0;
+}
+
+
+void
+maliit_metrics_end(MaliitHistogram histogram)
+{
+    Histogram *h = &histograms[histogram];
+    guint64 value;
+
+    if (!h->start)
+        return;
+
+    value = g_get_monotonic_time() - h->start;
+    h->start = 0;
+
+    h->buckets[bucket_index(value)]++;
+    h->count++;
+    h->sum += value;
+    h->max = MAX(h->max, value);
+}
+
+
+static guint64
+percentile(const Histogram *h, double fraction)
+{
+    guint64 rank = (guint64) (fraction * h->count + 0.5);
+    guint64 seen = 0;
+    guint i;
+
+    for (i = 0; i < N_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= MAX(rank, 1))
+            return bucket_value(i);
+    }
+
+    return h->max;
+}
+
+
+static void
+metrics_dump(void)
+{
+    FILE *file = fopen(metrics_path, "w");
+    guint i, j;
+
+    if (!file) {
+        g_warning("Unable to write the metrics to %s", metrics_path);
+        return;
+    }
+
+    for (i = 0; i < MALIIT_N_COUNTERS; i++)
+        fprintf(file, "%s %" G_GUINT64_FORMAT "\n", counter_names[i], maliit_counters[i]);
+
+    for (i = 0; i < MALIIT_N_HISTOGRAMS; i++) {
+        const Histogram *h = &histograms[i];
+
+        fprintf(file, "%s count=%" G_GUINT64_FORMAT, histogram_names[i], h->count);
+        if (h->count)
+            fprintf(file, " mean=%" G_GUINT64_FORMAT " p50=%" G_GUINT64_FORMAT
+                    " p90=%" G_GUINT64_FORMAT " p99=%" G_GUINT64_FORMAT " max=%" G_GUINT64_FORMAT,
+                    h->sum / h->count, percentile(h, 0.5), percentile(h, 0.9),
+                    percentile(h, 0.99), h->max);
+        fprintf(file, "\n");
+
+        /* The non-empty buckets, by their lowest value. */
+        for (j = 0; j < N_BUCKETS; j++)
+            if (h->buckets[j])
+                fprintf(file, "  %" G_GUINT64_FORMAT " %u\n", bucket_value(j), h->buckets[j]);
+    }
+
+    fclose(file);
+}
+
+
+static gboolean
+dump_on_signal(gpointer user_data G_GNUC_UNUSED)
+{
+    metrics_dump();
+    return G_SOURCE_CONTINUE;
+}
+
+
+void
+maliit_metrics_init(const char *path)
+{
+    if (metrics_path || !path)
+        return;
+
+    metrics_path = g_strdup(path);
+    DBG(MODULE, "metrics to %s", metrics_path);
+
+    g_unix_signal_add(SIGUSR2, dump_on_signal, NULL);
+}
+
+
+void
+maliit_metrics_exit(void)
+{
+    if (metrics_path)
+        metrics_dump();
+}
@@ -0,0 +1,93 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    /* Calls made to the server */
+    MALIIT_COUNTER_ACTIVATE_CONTEXT,
+    MALIIT_COUNTER_UPDATE_WIDGET_INFORMATION,
+    MALIIT_COUNTER_RESET,
+    MALIIT_COUNTER_SHOW_INPUT_METHOD,
+    MALIIT_COUNTER_HIDE_INPUT_METHOD,
+    MALIIT_COUNTER_PROCESS_KEY_EVENT,
+
+    /* Calls received from the server */
+    MALIIT_COUNTER_IM_INITIATED_HIDE,
+    MALIIT_COUNTER_COMMIT_STRING,
+    MALIIT_COUNTER_UPDATE_PREEDIT,
+    MALIIT_COUNTER_KEY_EVENT,
+    MALIIT_COUNTER_SET_REDIRECT_KEYS,
+    MALIIT_COUNTER_NOTIFY_EXTENDED_ATTRIBUTE_CHANGED,
+    MALIIT_COUNTER_UPDATE_INPUT_METHOD_AREA,
+    MALIIT_COUNTER_INVOKE_ACTION,
+
+    /* Work saved or done */
+    MALIIT_COUNTER_SURROUNDING_TEXT_BYTES,    /* surrounding text sent to the server */
+    MALIIT_COUNTER_WIDGET_INFORMATION_SKIPPED, /* updates that changed nothing */
+    MALIIT_COUNTER_KEY_EVENTS_FOLDED,         /* auto-repeats folded into a queued key event */
+    MALIIT_COUNTER_PREEDIT_DROPPED,           /* preedit updates that changed nothing */
+    MALIIT_COUNTER_PREEDIT_COALESCED,         /* preedit updates merged into a pending preedit-changed */
+    MALIIT_COUNTER_FOCUS_OUT_DEBOUNCED,       /* focus-outs dropped for a focus-in that followed */
+    MALIIT_COUNTER_SHOW_SKIPPED,              /* showInputMethod not sent as already shown */
+    MALIIT_COUNTER_RESET_SKIPPED,             /* reset not sent as the server was not composing */
+
+    MALIIT_N_COUNTERS
+} MaliitCounter;
+
+typedef enum {
+    MALIIT_HISTOGRAM_KEY_TO_COMMIT,  /* key press forwarded to the server -> commit emitted, sampled */
+    MALIIT_HISTOGRAM_FOCUS_TO_SHOW,  /* focus in -> showInputMethod sent */
+    MALIIT_N_HISTOGRAMS
+} MaliitHistogram;
+
+/* Counters are only touched from the main thread. */
+extern guint64 maliit_counters[MALIIT_N_COUNTERS];
+
+#define MALIIT_COUNT(counter) (maliit_counters[(counter)]++)
+#define MALIIT_COUNT_N(counter, n) (maliit_counters[(counter)] += (n))
+
+/* Start timing an interval of the histogram, dropping one that was
+ * started and never ended. */
+void maliit_metrics_begin(MaliitHistogram histogram);
+
+/* Start timing an interval unless one is being timed already, for events
+ * that can overlap, such as key presses sent ahead of the commit of the
+ * previous one: each interval then ends with the commit of the press
+ * that started it, and the presses in between go unmeasured. */
+void maliit_metrics_sample(MaliitHistogram histogram);
+
+/* Record the interval being timed, if any. */
+void maliit_metrics_end(MaliitHistogram histogram);
+
+/* Drop the interval being timed, when what it waited for is not going
+ * to happen. */
+void maliit_metrics_cancel(MaliitHistogram histogram);
+
+/* Given a file name, from MALIIT_METRICS, write the counters and
+ * histograms there whenever the process gets SIGUSR2, and on
+ * maliit_metrics_exit(). */
+void maliit_metrics_init(const char *path);
+void maliit_metrics_exit(void);
+
+G_END_DECLS
+
+#endif //_METRICS_H
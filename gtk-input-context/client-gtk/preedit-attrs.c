@@ -0,0 +1,134 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "preedit-attrs.h"
+
+#define N_FACES (MaliitPreeditActive + 1)
+
+/* Offsets of preedits up to this many characters are indexed on the stack. */
+#define STACK_INDEX_SIZE 256
+
+/* The attributes of each face, built once and copied for every segment. */
+static PangoAttribute *face_templates[N_FACES][2];
+
+
+static void
+build_face_templates(void)
+{
+    const guint16 gray = (2 << 15) - 1; /* halfway from 0 to 65535 */
+
+    face_templates[MaliitPreeditDefault][0] = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+    face_templates[MaliitPreeditDefault][1] = pango_attr_underline_color_new(0, 0, 0);
+
+    face_templates[MaliitPreeditNoCandidates][0] = pango_attr_underline_new(PANGO_UNDERLINE_ERROR);
+    face_templates[MaliitPreeditNoCandidates][1] = pango_attr_underline_color_new(65535, 0, 0);
+
+    face_templates[MaliitPreeditKeyPress][0] = pango_attr_underline_new(PANGO_UNDERLINE_SINGLE);
+    face_templates[MaliitPreeditKeyPress][1] = pango_attr_underline_color_new(0, 0, 0);
+
+    face_templates[MaliitPreeditUnconvertible][0] = pango_attr_foreground_new(gray, gray, gray);
+
+    face_templates[MaliitPreeditActive][0] = pango_attr_foreground_new(39168, 12800, 52224);
+    face_templates[MaliitPreeditActive][1] = pango_attr_weight_new(PANGO_WEIGHT_BOLD);
+}
+
+
+/* Byte offset of every character of string, and of its end, in one walk.
+ * Returns the number of characters, or -1 if string is not valid UTF-8;
+ * the caller frees *index if it is not stack_index. */
+static glong
+build_offset_index(const gchar *string, gint *stack_index, gint **index)
+{
+    const gchar *end;
+    const gchar *p;
+    glong n_chars = 0;
+
+    if (!g_utf8_validate(string, -1, &end))
+        return -1;
+
+    /* There are never more characters than bytes. */
+    if (end - string < STACK_INDEX_SIZE)
+        *index = stack_index;
+    else
+        *index = g_new(gint, end - string + 1);
+
+    for (p = string; p < end; p = g_utf8_next_char(p))
+        (*index)[n_chars++] = p - string;
+    (*index)[n_chars] = end - string;
+
+    return n_chars;
+}
+
+
+PangoAttrList *
+maliit_preedit_attrs_build(const gchar *string, GVariant *format_list)
+{
+    PangoAttrList *attrs = pango_attr_list_new();
+    gsize n_segments = g_variant_n_children(format_list);
+    gint stack_index[STACK_INDEX_SIZE];
+    gint *index = NULL;
+    glong n_chars = -1;
+    gsize i;
+
+    if (n_segments == 0)
+        return attrs;
+
+    if (!face_templates[MaliitPreeditDefault][0])
+        build_face_templates();
+
+    n_chars = build_offset_index(string, stack_index, &index);
+
+    for (i = 0; i < n_segments; i++) {
+        gint start;
+        gint length;
+        gint face;
+        guint byte_start;
+        guint byte_end;
+        gint j;
+
+        g_variant_get_child(format_list, i, "(iii)", &start, &length, &face);
+
+        if (face < 0 || face >= N_FACES)
+            face = MaliitPreeditDefault;
+
+        /* we get start and length in characters, but pango expects start
+         * and end indices in bytes. */
+        if (n_chars >= 0) {
+            byte_start = index[CLAMP(start, 0, n_chars)];
+            byte_end = index[CLAMP(start + length, 0, n_chars)];
+        } else {
+            byte_start = start;
+            byte_end = start + length;
+        }
+
+        for (j = 0; j < 2; j++) {
+            PangoAttribute *attr;
+
+            if (!face_templates[face][j])
+                continue;
+
+            attr = pango_attribute_copy(face_templates[face][j]);
+            attr->start_index = byte_start;
+            attr->end_index = byte_end;
+            pango_attr_list_insert(attrs, attr);
+        }
+    }
+
+    if (index != stack_index)
+        g_free(index);
+
+    return attrs;
+}
@@ -0,0 +1,41 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _PREEDIT_ATTRS_H
+#define _PREEDIT_ATTRS_H
+
+#include <glib.h>
+#include <pango/pango.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    MaliitPreeditDefault,
+    MaliitPreeditNoCandidates,
+    MaliitPreeditKeyPress,
+    MaliitPreeditUnconvertible,
+    MaliitPreeditActive
+} MaliitPreeditFace;
+
+/* Turn the format list of an updatePreedit call, (start, length, face)
+ * triples in characters, into Pango attributes over the bytes of string.
+ * Linear in the length of string plus the number of segments. */
+PangoAttrList *maliit_preedit_attrs_build(const gchar *string, GVariant *format_list);
+
+G_END_DECLS
+
+#endif //_PREEDIT_ATTRS_H
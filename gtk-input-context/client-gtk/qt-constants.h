@@ -0,0 +1,177 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _QT_CONSTANTS_H
+#define _QT_CONSTANTS_H
+
+// The Qt key, modifier and event type values spoken on the Maliit wire
+// protocol, as defined by Qt 5's qnamespace.h and qcoreevent.h. They are
+// part of Qt's stable ABI, so keeping a copy here saves every GTK process
+// that loads the immodule from mapping QtCore and QtGui just to read a
+// handful of enum values.
+
+namespace Qt {
+
+enum Key {
+    Key_Space                 = 0x00000020,
+    Key_Asterisk              = 0x0000002a,
+    Key_Plus                  = 0x0000002b,
+    Key_Comma                 = 0x0000002c,
+    Key_Minus                 = 0x0000002d,
+    Key_Period                = 0x0000002e,
+    Key_Slash                 = 0x0000002f,
+    Key_0                     = 0x00000030,
+    Key_1                     = 0x00000031,
+    Key_2                     = 0x00000032,
+    Key_3                     = 0x00000033,
+    Key_4                     = 0x00000034,
+    Key_5                     = 0x00000035,
+    Key_6                     = 0x00000036,
+    Key_7                     = 0x00000037,
+    Key_8                     = 0x00000038,
+    Key_9                     = 0x00000039,
+    Key_Equal                 = 0x0000003d,
+    Key_Escape                = 0x01000000,
+    Key_Tab                   = 0x01000001,
+    Key_Backtab               = 0x01000002,
+    Key_Backspace             = 0x01000003,
+    Key_Return                = 0x01000004,
+    Key_Enter                 = 0x01000005,
+    Key_Insert                = 0x01000006,
+    Key_Delete                = 0x01000007,
+    Key_Pause                 = 0x01000008,
+    Key_Print                 = 0x01000009,
+    Key_SysReq                = 0x0100000a,
+    Key_Clear                 = 0x0100000b,
+    Key_Home                  = 0x01000010,
+    Key_End                   = 0x01000011,
+    Key_Left                  = 0x01000012,
+    Key_Up                    = 0x01000013,
+    Key_Right                 = 0x01000014,
+    Key_Down                  = 0x01000015,
+    Key_PageUp                = 0x01000016,
+    Key_PageDown              = 0x01000017,
+    Key_Shift                 = 0x01000020,
+    Key_Control               = 0x01000021,
+    Key_Meta                  = 0x01000022,
+    Key_Alt                   = 0x01000023,
+    Key_CapsLock              = 0x01000024,
+    Key_NumLock               = 0x01000025,
+    Key_ScrollLock            = 0x01000026,
+    Key_F1                    = 0x01000030,
+    Key_F2                    = 0x01000031,
+    Key_F3                    = 0x01000032,
+    Key_F4                    = 0x01000033,
+    Key_F5                    = 0x01000034,
+    Key_F6                    = 0x01000035,
+    Key_F7                    = 0x01000036,
+    Key_F8                    = 0x01000037,
+    Key_F9                    = 0x01000038,
+    Key_F10                   = 0x01000039,
+    Key_F11                   = 0x0100003a,
+    Key_F12                   = 0x0100003b,
+    Key_F13                   = 0x0100003c,
+    Key_F14                   = 0x0100003d,
+    Key_F15                   = 0x0100003e,
+    Key_F16                   = 0x0100003f,
+    Key_F17                   = 0x01000040,
+    Key_F18                   = 0x01000041,
+    Key_F19                   = 0x01000042,
+    Key_F20                   = 0x01000043,
+    Key_Super_L               = 0x01000053,
+    Key_Super_R               = 0x01000054,
+    Key_Menu                  = 0x01000055,
+    Key_Hyper_L               = 0x01000056,
+    Key_Hyper_R               = 0x01000057,
+    Key_Help                  = 0x01000058,
+    Key_AltGr                 = 0x01001103,
+    Key_Multi_key             = 0x01001120,
+    Key_Kanji                 = 0x01001121,
+    Key_Muhenkan              = 0x01001122,
+    Key_Henkan                = 0x01001123,
+    Key_Romaji                = 0x01001124,
+    Key_Hiragana              = 0x01001125,
+    Key_Katakana              = 0x01001126,
+    Key_Hiragana_Katakana     = 0x01001127,
+    Key_Zenkaku               = 0x01001128,
+    Key_Hankaku               = 0x01001129,
+    Key_Zenkaku_Hankaku       = 0x0100112a,
+    Key_Touroku               = 0x0100112b,
+    Key_Massyo                = 0x0100112c,
+    Key_Kana_Lock             = 0x0100112d,
+    Key_Kana_Shift            = 0x0100112e,
+    Key_Eisu_Shift            = 0x0100112f,
+    Key_Eisu_toggle           = 0x01001130,
+    Key_Hangul                = 0x01001131,
+    Key_Hangul_Start          = 0x01001132,
+    Key_Hangul_End            = 0x01001133,
+    Key_Hangul_Hanja          = 0x01001134,
+    Key_Hangul_Jamo           = 0x01001135,
+    Key_Hangul_Romaja         = 0x01001136,
+    Key_Codeinput             = 0x01001137,
+    Key_Hangul_Jeonja         = 0x01001138,
+    Key_Hangul_Banja          = 0x01001139,
+    Key_Hangul_PreHanja       = 0x0100113a,
+    Key_Hangul_PostHanja      = 0x0100113b,
+    Key_SingleCandidate       = 0x0100113c,
+    Key_MultipleCandidate     = 0x0100113d,
+    Key_PreviousCandidate     = 0x0100113e,
+    Key_Hangul_Special        = 0x0100113f,
+    Key_Mode_switch           = 0x0100117e,
+    Key_Dead_Grave            = 0x01001250,
+    Key_Dead_Acute            = 0x01001251,
+    Key_Dead_Circumflex       = 0x01001252,
+    Key_Dead_Tilde            = 0x01001253,
+    Key_Dead_Macron           = 0x01001254,
+    Key_Dead_Breve            = 0x01001255,
+    Key_Dead_Abovedot         = 0x01001256,
+    Key_Dead_Diaeresis        = 0x01001257,
+    Key_Dead_Abovering        = 0x01001258,
+    Key_Dead_Doubleacute      = 0x01001259,
+    Key_Dead_Caron            = 0x0100125a,
+    Key_Dead_Cedilla          = 0x0100125b,
+    Key_Dead_Ogonek           = 0x0100125c,
+    Key_Dead_Iota             = 0x0100125d,
+    Key_Dead_Voiced_Sound     = 0x0100125e,
+    Key_Dead_Semivoiced_Sound = 0x0100125f,
+    Key_Dead_Belowdot         = 0x01001260,
+    Key_Dead_Hook             = 0x01001261,
+    Key_Dead_Horn             = 0x01001262,
+    Key_unknown               = 0x01ffffff
+};
+
+enum KeyboardModifier {
+    NoModifier                = 0x00000000,
+    ShiftModifier             = 0x02000000,
+    ControlModifier           = 0x04000000,
+    AltModifier               = 0x08000000,
+    MetaModifier              = 0x10000000
+};
+
+constexpr int UNICODE_ACCEL = 0x00000000;
+
+} // namespace Qt
+
+namespace QEvent {
+
+enum Type {
+    KeyPress                  = 6,
+    KeyRelease                = 7
+};
+
+} // namespace QEvent
+
+#endif //_QT_CONSTANTS_H
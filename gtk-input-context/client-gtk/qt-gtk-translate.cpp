@@ -20,27 +20,140 @@
  */
 
 #include "debug.h"
-#include <QEvent>
-#include <QKeyEvent>
-
+#include "qt-constants.h"
 #include "qt-keysym-map.h"
+#include "qt-gtk-translate.h"
+
 
-// To workaround glib >= 2.25 where signals is used, while QT already define it as C++ keyword: protected
-#ifdef signals
-#undef signals
+namespace {
+
+/* What composing key events needs to know of a display, looked up once
+ * and kept on the GdkDisplay: the keycode and group of each keyval asked
+ * for so far and, on GTK 3, the keyboard device. */
+struct DisplayKeyCache {
+	GdkKeymap *keymap;
+	gulong keys_changed_id;
+	GHashTable *keycodes; /* keyval -> (group << 16 | keycode), 0 if not on the keymap */
+#if GTK_CHECK_VERSION (3, 0, 0)
+	GdkDeviceManager *device_manager;
+	gulong device_ids[3];
+	GdkDevice *keyboard; /* not referenced, dropped on device changes */
 #endif
-#include "qt-gtk-translate.h"
+};
+
+const char * const DISPLAY_KEY_CACHE = "maliit-display-key-cache";
+
+void
+keys_changed(GdkKeymap *keymap, gpointer user_data)
+{
+	UNUSED(keymap);
+	DisplayKeyCache *cache = static_cast<DisplayKeyCache *>(user_data);
+
+	DBG(KEYS, "keymap changed, dropping %u keycodes", g_hash_table_size(cache->keycodes));
+	g_hash_table_remove_all(cache->keycodes);
+}
+
+#if GTK_CHECK_VERSION (3, 0, 0)
+void
+devices_changed(GdkDeviceManager *device_manager, GdkDevice *device, gpointer user_data)
+{
+	UNUSED(device_manager);
+	UNUSED(device);
+	DisplayKeyCache *cache = static_cast<DisplayKeyCache *>(user_data);
+
+	cache->keyboard = NULL;
+}
+#endif
+
+void
+display_key_cache_free(gpointer data)
+{
+	DisplayKeyCache *cache = static_cast<DisplayKeyCache *>(data);
+
+	g_signal_handler_disconnect(cache->keymap, cache->keys_changed_id);
+	g_hash_table_destroy(cache->keycodes);
+#if GTK_CHECK_VERSION (3, 0, 0)
+	for (gulong id : cache->device_ids)
+		g_signal_handler_disconnect(cache->device_manager, id);
+#endif
+	g_slice_free(DisplayKeyCache, cache);
+}
+
+DisplayKeyCache *
+get_display_key_cache(GdkDisplay *display)
+{
+	DisplayKeyCache *cache = static_cast<DisplayKeyCache *>(
+		g_object_get_data(G_OBJECT(display), DISPLAY_KEY_CACHE));
+
+	if (cache)
+		return cache;
+
+	cache = g_slice_new0(DisplayKeyCache);
+	cache->keymap = gdk_keymap_get_for_display(display);
+	cache->keys_changed_id = g_signal_connect(cache->keymap, "keys-changed",
+	                                          G_CALLBACK(keys_changed), cache);
+	cache->keycodes = g_hash_table_new(NULL, NULL);
+#if GTK_CHECK_VERSION (3, 0, 0)
+	cache->device_manager = gdk_display_get_device_manager(display);
+	cache->device_ids[0] = g_signal_connect(cache->device_manager, "device-added",
+	                                        G_CALLBACK(devices_changed), cache);
+	cache->device_ids[1] = g_signal_connect(cache->device_manager, "device-removed",
+	                                        G_CALLBACK(devices_changed), cache);
+	cache->device_ids[2] = g_signal_connect(cache->device_manager, "device-changed",
+	                                        G_CALLBACK(devices_changed), cache);
+#endif
+
+	g_object_set_data_full(G_OBJECT(display), DISPLAY_KEY_CACHE, cache, display_key_cache_free);
+
+	return cache;
+}
+
+void
+lookup_keycode(DisplayKeyCache *cache, guint keyval, guint16 *keycode, guint8 *group)
+{
+	gpointer packed;
+
+	if (!g_hash_table_lookup_extended(cache->keycodes, GUINT_TO_POINTER(keyval), NULL, &packed)) {
+		GdkKeymapKey *keys;
+		gint n;
+		guint value = 0;
+
+		if (gdk_keymap_get_entries_for_keyval(cache->keymap, keyval, &keys, &n)) {
+			value = (keys[0].group & 0xff) << 16 | (keys[0].keycode & 0xffff);
+			g_free(keys);
+		}
+
+		packed = GUINT_TO_POINTER(value);
+		g_hash_table_insert(cache->keycodes, GUINT_TO_POINTER(keyval), packed);
+	}
+
+	*keycode = GPOINTER_TO_UINT(packed) & 0xffff;
+	*group = GPOINTER_TO_UINT(packed) >> 16;
+}
+
+#if GTK_CHECK_VERSION (3, 0, 0)
+GdkDevice *
+get_keyboard(DisplayKeyCache *cache)
+{
+	if (!cache->keyboard) {
+		GdkDevice *client_pointer = gdk_device_manager_get_client_pointer(cache->device_manager);
+
+		cache->keyboard = gdk_device_get_associated_device(client_pointer);
+	}
+
+	return cache->keyboard;
+}
+#endif
+
+} // namespace
 
 
 GdkEventKey *
 compose_gdk_keyevent(GdkEventType type, guint keyval, guint state, GdkWindow *window)
 {
 	GdkEventKey *event = NULL;
-#if GTK_CHECK_VERSION (3, 0, 0)
-	GdkDisplay *display;
-	GdkDeviceManager *device_manager;
-	GdkDevice *client_pointer;
-#endif
+	DisplayKeyCache *cache = NULL;
+
 	if ((type != GDK_KEY_PRESS) && (type != GDK_KEY_RELEASE))
 		return NULL;
 
@@ -51,13 +164,12 @@ compose_gdk_keyevent(GdkEventType type, guint keyval, guint state, GdkWindow *wi
 	event->time = GDK_CURRENT_TIME;
 	event->state = state;
 
-#if GTK_CHECK_VERSION (3, 0, 0)
-	display = gdk_window_get_display (window);
-	device_manager = gdk_display_get_device_manager (display);
-	client_pointer = gdk_device_manager_get_client_pointer (device_manager);
+	if (window)
+		cache = get_display_key_cache(gdk_window_get_display(window));
 
-	gdk_event_set_device ((GdkEvent *)event,
-			      gdk_device_get_associated_device (client_pointer));
+#if GTK_CHECK_VERSION (3, 0, 0)
+	if (cache)
+		gdk_event_set_device ((GdkEvent *)event, get_keyboard(cache));
 #endif
 
 	if (type == GDK_KEY_RELEASE)
@@ -66,22 +178,12 @@ compose_gdk_keyevent(GdkEventType type, guint keyval, guint state, GdkWindow *wi
 	event->window = window;
 
 	if (event->window) {
-		GdkKeymap *key_map = gdk_keymap_get_default();
-		GdkKeymapKey *keys;
-		gint n;
-
 		g_object_ref(event->window); // seems when event is freed, the event->window will be unref
 
-		if (gdk_keymap_get_entries_for_keyval(key_map, event->keyval, &keys, &n)) {
-			event->hardware_keycode = keys[0].keycode;
-			event->group = keys[0].group;
-		} else {
-			event->hardware_keycode = 0;
-			event->group = 0;
-		}
+		lookup_keycode(cache, event->keyval, &event->hardware_keycode, &event->group);
 	}
 
-	DBG("event type=0x%x, state=0x%x, keyval=0x%x, keycode=0x%x, group=%d",
+	DBG(KEYS, "event type=0x%x, state=0x%x, keyval=0x%x, keycode=0x%x, group=%d",
 		event->type, event->state, event->keyval, event->hardware_keycode, event->group);
 
 	return event;
@@ -92,11 +194,11 @@ compose_gdk_keyevent(GdkEventType type, guint keyval, guint state, GdkWindow *wi
 GdkEventKey *
 qt_key_event_to_gdk(int type, int key, int modifiers, const char *text, GdkWindow *window)
 {
-	Q_UNUSED(text);
+	UNUSED(text);
 	guint state = 0;
 	guint keyval;
 
-	STEP();
+	STEP(KEYS);
 	if ((type != QEvent::KeyPress) && (type != QEvent::KeyRelease))
 		return NULL;
 
@@ -135,7 +237,7 @@ gdk_key_event_to_qt(GdkEventKey *event, int *type, int *key, int *modifier)
 
 	*key = XKeySymToQTKey(event->keyval);
 	if (*key == Qt::Key_unknown) {
-		qWarning("Unkonwn key");
+		g_warning("Unknown key");
 		return FALSE;
 	}
 
@@ -149,7 +251,32 @@ gdk_key_event_to_qt(GdkEventKey *event, int *type, int *key, int *modifier)
 	if (event->state & GDK_META_MASK)
 		*modifier |= Qt::MetaModifier;
 
-	DBG("qtkey type =%d, qtkey=0x%x, modifier=0x%x", *type, *key, *modifier);
+	DBG(KEYS, "qtkey type =%d, qtkey=0x%x, modifier=0x%x", *type, *key, *modifier);
+
+	return TRUE;
+}
+
+
+gboolean
+qt_key_event_is_text_input(int type, int modifiers, const char *text, gboolean *is_press)
+{
+	const char *end;
+
+	if ((type != QEvent::KeyPress) && (type != QEvent::KeyRelease))
+		return FALSE;
+
+	if (modifiers & (Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier))
+		return FALSE;
+
+	if (!text || !text[0] || !g_utf8_validate(text, -1, &end))
+		return FALSE;
+
+	for (const char *p = text; p < end; p = g_utf8_next_char(p)) {
+		if (g_unichar_iscntrl(g_utf8_get_char(p)))
+			return FALSE;
+	}
+
+	*is_press = type == QEvent::KeyPress;
 
 	return TRUE;
 }
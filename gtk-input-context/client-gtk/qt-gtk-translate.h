@@ -29,6 +29,10 @@ GdkEventKey *compose_gdk_keyevent(GdkEventType type, guint keyval, guint state,
 GdkEventKey *qt_key_event_to_gdk(int type, int key, int modifiers, const char *text, GdkWindow *window);
 gboolean gdk_key_event_to_qt(GdkEventKey *event, int *type, int *key, int *modifier);
 
+/* Whether the Qt key press or release only types its text: it has
+ * printable text and no Control, Alt or Meta modifier. */
+gboolean qt_key_event_is_text_input(int type, int modifiers, const char *text, gboolean *is_press);
+
 G_END_DECLS
 
 #endif //_QT_GTK_TRANSLATE_H
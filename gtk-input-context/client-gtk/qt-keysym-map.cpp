@@ -21,9 +21,11 @@
  */
 
 
+#include <cstddef>
+
 #include <gdk/gdkkeysyms.h>
-#include <qstring.h>
 
+#include "qt-constants.h"
 #include "qt-keysym-map.h"
 #include "debug.h"
 
@@ -34,7 +36,7 @@ typedef struct {
 } KeySymMap;
 
 // keyboard mapping table, modified from QKeymapper_x11.cpp
-static const KeySymMap QtKeyXSymMaps[] = {
+static constexpr KeySymMap QtKeyXSymMaps[] = {
 
 // misc keys
 
@@ -236,23 +238,177 @@ static const KeySymMap QtKeyXSymMaps[] = {
 	{ 0,                          0}
 };
 
+
+namespace {
+
+// Both lookup directions are served by perfect hash tables generated at
+// compile time from QtKeyXSymMaps (hash and displace): a key is hashed to
+// a bucket, and the seed stored for that bucket sends every key of the
+// bucket to a slot of its own. A lookup is two hashes and one comparison,
+// however many entries the source table has.
+
+constexpr std::size_t KeySymMapCount = sizeof(QtKeyXSymMaps) / sizeof(KeySymMap);
+
+constexpr std::size_t
+nextPowerOfTwo(std::size_t n)
+{
+	std::size_t size = 1;
+	while (size < n)
+		size <<= 1;
+	return size;
+}
+
+constexpr std::size_t SlotCount = nextPowerOfTwo(KeySymMapCount * 2);
+constexpr std::size_t BucketCount = nextPowerOfTwo(KeySymMapCount / 4 + 1);
+constexpr unsigned int MaxSeed = 1 << 16;
+
+constexpr unsigned int
+hashKey(unsigned int key, unsigned int seed)
+{
+	unsigned int h = key ^ (seed * 0x9e3779b9u);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	return h;
+}
+
+enum LookupDirection {
+	LookupQtKey,
+	LookupXKeySym
+};
+
+struct PerfectHashTable {
+	unsigned int seeds[BucketCount];
+	unsigned int keys[SlotCount];   // 0 marks an empty slot
+	int values[SlotCount];
+	bool complete;
+};
+
+constexpr unsigned int
+entryKey(std::size_t i, LookupDirection direction)
+{
+	return direction == LookupQtKey ? QtKeyXSymMaps[i].XKeySym
+	                                : (unsigned int)QtKeyXSymMaps[i].QtKey;
+}
+
+constexpr int
+entryValue(std::size_t i, LookupDirection direction)
+{
+	return direction == LookupQtKey ? QtKeyXSymMaps[i].QtKey
+	                                : (int)QtKeyXSymMaps[i].XKeySym;
+}
+
+constexpr PerfectHashTable
+buildPerfectHashTable(LookupDirection direction)
+{
+	PerfectHashTable table {};
+	std::size_t bucket_of[KeySymMapCount] = {};
+	bool used[KeySymMapCount] = {};
+	std::size_t bucket_size[BucketCount] = {};
+	bool bucket_done[BucketCount] = {};
+	bool slot_taken[SlotCount] = {};
+
+	// Like the linear search this replaces, the first entry for a key wins.
+	for (std::size_t i = 0; i < KeySymMapCount; i++) {
+		const unsigned int key = entryKey(i, direction);
+
+		used[i] = key != 0;
+		for (std::size_t j = 0; used[i] && j < i; j++)
+			if (entryKey(j, direction) == key)
+				used[i] = false;
+
+		if (used[i]) {
+			bucket_of[i] = hashKey(key, 0) & (BucketCount - 1);
+			bucket_size[bucket_of[i]]++;
+		}
+	}
+
+	// Place the largest buckets first, while the table is still empty.
+	for (std::size_t round = 0; round < BucketCount; round++) {
+		std::size_t bucket = BucketCount;
+		for (std::size_t b = 0; b < BucketCount; b++)
+			if (!bucket_done[b] && (bucket == BucketCount || bucket_size[b] > bucket_size[bucket]))
+				bucket = b;
+
+		bucket_done[bucket] = true;
+		if (bucket_size[bucket] == 0)
+			continue;
+
+		std::size_t members[KeySymMapCount] = {};
+		std::size_t member_count = 0;
+		for (std::size_t i = 0; i < KeySymMapCount; i++)
+			if (used[i] && bucket_of[i] == bucket)
+				members[member_count++] = i;
+
+		unsigned int seed = 1;
+		for (; seed < MaxSeed; seed++) {
+			std::size_t slots[KeySymMapCount] = {};
+			bool fits = true;
+
+			for (std::size_t m = 0; fits && m < member_count; m++) {
+				slots[m] = hashKey(entryKey(members[m], direction), seed) & (SlotCount - 1);
+				fits = !slot_taken[slots[m]];
+				for (std::size_t n = 0; fits && n < m; n++)
+					fits = slots[n] != slots[m];
+			}
+
+			if (fits) {
+				for (std::size_t m = 0; m < member_count; m++) {
+					slot_taken[slots[m]] = true;
+					table.keys[slots[m]] = entryKey(members[m], direction);
+					table.values[slots[m]] = entryValue(members[m], direction);
+				}
+				table.seeds[bucket] = seed;
+				break;
+			}
+		}
+
+		if (seed == MaxSeed)
+			return table;
+	}
+
+	table.complete = true;
+	return table;
+}
+
+constexpr PerfectHashTable QtKeyTable = buildPerfectHashTable(LookupQtKey);
+constexpr PerfectHashTable XKeySymTable = buildPerfectHashTable(LookupXKeySym);
+
+static_assert(QtKeyTable.complete, "no perfect hash found for the X keysym to Qt key table");
+static_assert(XKeySymTable.complete, "no perfect hash found for the Qt key to X keysym table");
+
+inline bool
+lookupPerfectHash(const PerfectHashTable &table, unsigned int key, int *value)
+{
+	const unsigned int seed = table.seeds[hashKey(key, 0) & (BucketCount - 1)];
+	const std::size_t slot = hashKey(key, seed) & (SlotCount - 1);
+
+	if (table.keys[slot] != key)
+		return false;
+
+	*value = table.values[slot];
+	return true;
+}
+
+} // namespace
+
 int
 QtKeyToXKeySym(int qtKey) {
 
 	// TODO: Need to complete this function for all scenario.
-	int i;
-	int count = sizeof(QtKeyXSymMaps)/sizeof(KeySymMap);
+	int keySym;
 
 	if (qtKey < 0x1000) {
 		//return QChar(qtKey).toLower().unicode();
 		return qtKey;
 	}
 
-	for(i = 0; i < count; i++ ) {
-		if( QtKeyXSymMaps[i].QtKey == qtKey ) {
-			return QtKeyXSymMaps[i].XKeySym;
-		}
-	}
+	if (lookupPerfectHash(XKeySymTable, (unsigned int)qtKey, &keySym))
+		return keySym;
 
         return 0;
 }
@@ -261,8 +417,7 @@ QtKeyToXKeySym(int qtKey) {
 int
 XKeySymToQTKey(uint keySym)
 {
-	int i;
-	int count = sizeof(QtKeyXSymMaps)/sizeof(KeySymMap);
+	int qtKey;
 
 	if ((keySym < 0x1000)) {
 		//if (keySym >= 'a' && keySym <= 'z')
@@ -270,17 +425,11 @@ XKeySymToQTKey(uint keySym)
 		return keySym;
 	}
 
-#ifdef Q_WS_WIN
-        if(keySym < 0x3000)
-                return keySym;
-#else
 	if (keySym < 0x3000 )
 		return keySym | Qt::UNICODE_ACCEL;
 
-	for(i = 0; i < count; i++)
-		if(QtKeyXSymMaps[i].XKeySym == keySym)
-			return QtKeyXSymMaps[i].QtKey;
-#endif
+	if (lookupPerfectHash(QtKeyTable, keySym, &qtKey))
+		return qtKey;
+
         return Qt::Key_unknown;
 }
-
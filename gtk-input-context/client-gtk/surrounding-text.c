@@ -0,0 +1,177 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "surrounding-text.h"
+#include "debug.h"
+
+/* Enough context for word prediction and auto-capitalization, while a
+ * paragraph of a GtkTextView can be hundreds of KB. */
+#define DEFAULT_WINDOW_SIZE 256
+
+gint
+maliit_surrounding_text_window_size(void)
+{
+    static gint window_size = -1;
+
+    if (window_size == -1) {
+        const char *value = g_getenv("MALIIT_SURROUNDING_TEXT_WINDOW");
+        long size = value ? strtol(value, NULL, 10) : 0;
+
+        window_size = size > 0 && size <= G_MAXINT ? (gint) size : DEFAULT_WINDOW_SIZE;
+        DBG(WIDGET_INFO, "surrounding text window: %d characters", window_size);
+    }
+
+    return window_size;
+}
+
+
+/* Like g_utf8_next_char(), but stops at the terminating NUL whatever the
+ * lead byte claims, so that invalid text is never read past its end. */
+static const gchar *
+next_char(const gchar *p)
+{
+    for (p++; (*p & 0xc0) == 0x80; p++)
+        ;
+
+    return p;
+}
+
+
+/* Only the window is decoded; the text ahead of the cursor is only checked
+ * for a NUL, so that a cursor past the end is caught. Returns the number
+ * of characters before the cursor, or -1. The window may still be invalid
+ * UTF-8, but it lies within the text. */
+static gint
+find_window(const gchar *text, gint cursor_index, gint window,
+            const gchar **start, const gchar **end)
+{
+    const gchar *cursor;
+    gint before = 0;
+    gint i;
+
+    cursor_index = MAX(cursor_index, 0);
+    if (memchr(text, '\0', cursor_index))
+        return -1;
+    cursor = text + cursor_index;
+
+    *start = cursor;
+    for (i = 0; i < window && *start > text; i++) {
+        *start = g_utf8_find_prev_char(text, *start);
+        if (!*start)
+            return -1;
+        before++;
+    }
+
+    *end = cursor;
+    for (i = 0; i < window && **end; i++)
+        *end = next_char(*end);
+
+    return before;
+}
+
+
+gchar *
+maliit_surrounding_text_extract(const gchar *text, gint cursor_index, gint window,
+                                gint *window_cursor, gint *window_offset)
+{
+    const gchar *start, *end;
+    gint before = find_window(text, cursor_index, window, &start, &end);
+
+    if (before < 0 || !g_utf8_validate(start, end - start, NULL))
+        return NULL;
+
+    /* Counting the characters ahead of the window is the one step that
+     * depends on the length of the text; it does not decode them. */
+    *window_cursor = before;
+    *window_offset = g_utf8_pointer_to_offset(text, start);
+
+    return g_strndup(start, end - start);
+}
+
+
+/* FNV-1a */
+static guint
+hash_bytes(const gchar *start, const gchar *end)
+{
+    guint hash = 2166136261u;
+
+    for (; start < end; start++) {
+        hash ^= (guchar) *start;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+void
+maliit_surrounding_text_cache_invalidate(MaliitSurroundingTextCache *cache)
+{
+    g_clear_pointer(&cache->text, g_variant_unref);
+    g_clear_pointer(&cache->cursor, g_variant_unref);
+    g_clear_pointer(&cache->offset, g_variant_unref);
+}
+
+
+gboolean
+maliit_surrounding_text_cache_update(MaliitSurroundingTextCache *cache,
+                                     const gchar *text, gint cursor_index, gint window)
+{
+    const gchar *start, *end;
+    gint window_cursor, window_offset, prefix_chars;
+    gchar *window_text;
+    guint hash;
+
+    if (find_window(text, cursor_index, window, &start, &end) < 0) {
+        maliit_surrounding_text_cache_invalidate(cache);
+        return FALSE;
+    }
+
+    hash = hash_bytes(start, end);
+
+    /* An edit ahead of the window can keep its byte position and still
+     * change the number of characters before it, which is the offset. */
+    prefix_chars = g_utf8_pointer_to_offset(text, start);
+
+    if (cache->text &&
+        cache->hash == hash &&
+        cache->cursor_index == cursor_index &&
+        cache->start_index == start - text &&
+        cache->length == (gsize) (end - start) &&
+        cache->prefix_chars == prefix_chars)
+        return TRUE;
+
+    maliit_surrounding_text_cache_invalidate(cache);
+
+    window_text = maliit_surrounding_text_extract(text, cursor_index, window,
+                                                  &window_cursor, &window_offset);
+    if (!window_text)
+        return FALSE;
+
+    cache->hash = hash;
+    cache->cursor_index = cursor_index;
+    cache->start_index = start - text;
+    cache->length = end - start;
+    cache->prefix_chars = prefix_chars;
+    cache->text = g_variant_ref_sink(g_variant_new_take_string(window_text));
+    cache->cursor = g_variant_ref_sink(g_variant_new_int32(window_cursor));
+    cache->offset = g_variant_ref_sink(g_variant_new_int32(window_offset));
+
+    return TRUE;
+}
@@ -0,0 +1,60 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _SURROUNDING_TEXT_H
+#define _SURROUNDING_TEXT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Number of characters sent on each side of the cursor, from
+ * MALIIT_SURROUNDING_TEXT_WINDOW. */
+gint maliit_surrounding_text_window_size(void);
+
+/* Cut the part of text within window characters of cursor_index (a byte
+ * index, as GTK reports it). Returns the window, the cursor position in
+ * it and its position in text, both in characters, or NULL if the text
+ * around the cursor is not valid UTF-8. */
+gchar *maliit_surrounding_text_extract(const gchar *text, gint cursor_index, gint window,
+                                       gint *window_cursor, gint *window_offset);
+
+/* The values last put into the widget state for the surrounding text,
+ * keyed by a hash of the window, the cursor index and the number of
+ * characters ahead of the window, so that unchanged text is neither
+ * copied nor serialized again. */
+typedef struct {
+    guint hash;
+    gint cursor_index;
+    gint start_index;
+    gsize length;
+    gint prefix_chars;
+    GVariant *text;
+    GVariant *cursor;
+    GVariant *offset;
+} MaliitSurroundingTextCache;
+
+/* Bring the cache up to date with text; returns FALSE if there is nothing
+ * to send. Its variants then describe the window around the cursor. */
+gboolean maliit_surrounding_text_cache_update(MaliitSurroundingTextCache *cache,
+                                              const gchar *text, gint cursor_index, gint window);
+
+/* Forget the cached values, after the text was changed by the input method. */
+void maliit_surrounding_text_cache_invalidate(MaliitSurroundingTextCache *cache);
+
+G_END_DECLS
+
+#endif //_SURROUNDING_TEXT_H
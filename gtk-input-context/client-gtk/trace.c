@@ -0,0 +1,215 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "trace.h"
+#include "debug.h"
+
+/* A power of two. At 16 bytes a record, the buffer only takes memory once
+ * tracing writes to it. */
+#define TRACE_BUFFER_SIZE 16384
+
+typedef struct {
+    gint64 time; /* CLOCK_MONOTONIC, in ns, as sysprof uses */
+    guint32 sequence;
+    guint32 point;
+} TraceRecord;
+
+gboolean maliit_trace_enabled = FALSE;
+
+static TraceRecord trace_buffer[TRACE_BUFFER_SIZE];
+static gint trace_next = 0;   /* records written so far, wraps at 2^32 */
+static gint trace_sequence = 0;
+static gchar *trace_path = NULL;
+
+static const char * const point_names[MALIIT_TRACE_N_POINTS] = {
+    "filter-key-event",
+    "process-key-event",
+    "commit-string",
+    "update-preedit",
+    "key-event",
+    "emit-commit",
+    "emit-preedit-changed",
+    "put-key-event",
+};
+
+
+static gint64
+trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+
+/* Writers claim a slot with one atomic add and never wait. A reader may
+ * see a slot that is being overwritten, which only matters once the
+ * buffer has wrapped, and only for the oldest records. */
+void
+maliit_trace_record(MaliitTracePoint point, guint sequence)
+{
+    guint slot = (guint) g_atomic_int_add(&trace_next, 1) & (TRACE_BUFFER_SIZE - 1);
+    TraceRecord *record = &trace_buffer[slot];
+
+    record->time = trace_now();
+    record->sequence = sequence;
+    record->point = point;
+}
+
+
+guint
+maliit_trace_begin_sequence(void)
+{
+    return (guint) g_atomic_int_add(&trace_sequence, 1) + 1;
+}
+
+
+guint
+maliit_trace_sequence(void)
+{
+    return (guint) g_atomic_int_get(&trace_sequence);
+}
+
+
+/* The records still in the buffer, oldest first. */
+static void
+trace_range(guint *first, guint *count)
+{
+    guint written = (guint) g_atomic_int_get(&trace_next);
+
+    *count = MIN(written, TRACE_BUFFER_SIZE);
+    *first = written - *count;
+}
+
+
+static void
+export_text(FILE *file)
+{
+    guint first, count, i;
+
+    trace_range(&first, &count);
+
+    fprintf(file, "# time_ns\tsequence\tpoint\n");
+    for (i = 0; i < count; i++) {
+        const TraceRecord *record = &trace_buffer[(first + i) & (TRACE_BUFFER_SIZE - 1)];
+
+        fprintf(file, "%" G_GINT64_FORMAT "\t%u\t%s\n",
+                record->time, record->sequence,
+                record->point < MALIIT_TRACE_N_POINTS ? point_names[record->point] : "?");
+    }
+}
+
+
+#ifdef HAVE_SYSPROF
+/* One instant mark per record, and one mark per sequence spanning its
+ * records, which is the latency of that keystroke. */
+static void
+export_sysprof(SysprofCaptureWriter *writer)
+{
+    GHashTable *spans = g_hash_table_new(NULL, NULL);
+    GHashTableIter iter;
+    gpointer key, value;
+    guint first, count, i;
+    gint32 pid = getpid();
+
+    trace_range(&first, &count);
+
+    for (i = 0; i < count; i++) {
+        const TraceRecord *record = &trace_buffer[(first + i) & (TRACE_BUFFER_SIZE - 1)];
+        gint64 *span;
+
+        sysprof_capture_writer_add_mark(writer, record->time, -1, pid, 0, "maliit",
+                                        record->point < MALIIT_TRACE_N_POINTS ? point_names[record->point] : "?",
+                                        NULL);
+
+        span = g_hash_table_lookup(spans, GUINT_TO_POINTER(record->sequence));
+        if (!span) {
+            span = g_new(gint64, 2);
+            span[0] = record->time;
+            g_hash_table_insert(spans, GUINT_TO_POINTER(record->sequence), span);
+        }
+        span[1] = record->time;
+    }
+
+    g_hash_table_iter_init(&iter, spans);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gint64 *span = value;
+        gchar *message = g_strdup_printf("sequence %u", GPOINTER_TO_UINT(key));
+
+        sysprof_capture_writer_add_mark(writer, span[0], -1, pid, span[1] - span[0],
+                                        "maliit", "keystroke", message);
+        g_free(message);
+        g_free(span);
+    }
+
+    g_hash_table_destroy(spans);
+    sysprof_capture_writer_flush(writer);
+}
+#endif /* HAVE_SYSPROF */
+
+
+void
+maliit_trace_exit(void)
+{
+    FILE *file;
+
+    if (!maliit_trace_enabled)
+        return;
+
+#ifdef HAVE_SYSPROF
+    if (g_str_has_suffix(trace_path, ".syscap")) {
+        SysprofCaptureWriter *writer = sysprof_capture_writer_new(trace_path, 0);
+
+        if (writer) {
+            export_sysprof(writer);
+            sysprof_capture_writer_unref(writer);
+        } else {
+            g_warning("Unable to write the trace to %s", trace_path);
+        }
+        return;
+    }
+#endif /* HAVE_SYSPROF */
+
+    file = fopen(trace_path, "w");
+    if (!file) {
+        g_warning("Unable to write the trace to %s", trace_path);
+        return;
+    }
+
+    export_text(file);
+    fclose(file);
+}
+
+
+void
+maliit_trace_init(const char *path)
+{
+    if (trace_path || !path)
+        return;
+
+    trace_path = g_strdup(path);
+    maliit_trace_enabled = TRUE;
+    DBG(MODULE, "tracing to %s", trace_path);
+}
@@ -0,0 +1,76 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Points on the path of a keystroke, from the hardware key event to what
+ * reaches the widget. */
+typedef enum {
+    MALIIT_TRACE_FILTER_KEY_EVENT,      /* filter_keypress entered, starts a sequence */
+    MALIIT_TRACE_PROCESS_KEY_EVENT,     /* processKeyEvent sent to the server */
+    MALIIT_TRACE_COMMIT_STRING,         /* commitString received */
+    MALIIT_TRACE_UPDATE_PREEDIT,        /* updatePreedit received */
+    MALIIT_TRACE_KEY_EVENT,             /* keyEvent received */
+    MALIIT_TRACE_EMIT_COMMIT,           /* commit emitted on the context */
+    MALIIT_TRACE_EMIT_PREEDIT_CHANGED,  /* preedit-changed emitted on the context */
+    MALIIT_TRACE_PUT_KEY_EVENT,         /* synthetic key event queued with GDK */
+    MALIIT_TRACE_N_POINTS
+} MaliitTracePoint;
+
+/* Set by maliit_trace_init(); read directly so that a disabled trace
+ * point costs one predictable branch. */
+extern gboolean maliit_trace_enabled;
+
+/* Record the point in the ring buffer, as part of the given sequence. */
+void maliit_trace_record(MaliitTracePoint point, guint sequence);
+
+/* Start the sequence of a new keystroke. Replies from the server carry no
+ * sequence id of their own: they are attributed to the latest keystroke,
+ * which maliit_trace_sequence() returns. */
+guint maliit_trace_begin_sequence(void);
+guint maliit_trace_sequence(void);
+
+/* Given a file name, from MALIIT_TRACE, enable tracing. */
+void maliit_trace_init(const char *path);
+
+/* Write the buffer to that file: as sysprof marks if the name ends with
+ * .syscap and sysprof support is built in, as tab-separated text
+ * otherwise. Does nothing unless tracing is enabled. */
+void maliit_trace_exit(void);
+
+#define MALIIT_TRACE(point) G_STMT_START {                              \
+        if (G_UNLIKELY(maliit_trace_enabled))                           \
+            maliit_trace_record((point), maliit_trace_sequence());      \
+    } G_STMT_END
+
+#define MALIIT_TRACE_BEGIN(point) G_STMT_START {                        \
+        if (G_UNLIKELY(maliit_trace_enabled))                           \
+            maliit_trace_record((point), maliit_trace_begin_sequence()); \
+    } G_STMT_END
+
+#define MALIIT_TRACE_SEQUENCE(point, sequence) G_STMT_START {           \
+        if (G_UNLIKELY(maliit_trace_enabled))                           \
+            maliit_trace_record((point), (sequence));                   \
+    } G_STMT_END
+
+G_END_DECLS
+
+#endif //_TRACE_H